@@ -0,0 +1,173 @@
+"""Serial flashing using raw binary records over USB STDIO
+
+Record layout (little-endian), see include/bin.h:
+    magic u32 | crc32 u32 | address u32 | length u16 | payload
+
+The CRC32 covers the address, length and payload. The device prompts with READY for every record, the host sends
+the current record on every prompt until the device answers ACK. A prompt sent before the port was open is lost, so
+the record is also sent again when the device has been quiet for a while. The device ACKs a repeat of the record it
+last wrote without writing it again. A record with no payload ends the image.
+
+A record for BIN_RESUME_ADDRESS carrying the CRC32 and size of the program asks how many of its sectors a transfer
+that was cut short already wrote. It is ACKed with the count following as a u32, those sectors are not sent again.
+
+The image is the _OUT.bin the build produces, flash from FLASH_BOOTLOADER_ORIGIN on. Everything from the flash
+header on is sent, the bootloader itself is not.
+"""
+import binascii
+import struct
+import sys
+import time
+from typing import List, Optional, Tuple
+
+import serial
+
+BIN_MAGIC = 0x4E424D50
+BIN_PAYLOAD_MAX = 4096
+
+BIN_READY = 0x00
+BIN_ACK = 0x01
+BIN_FAIL = 0x02
+
+# Times the current record is sent again without hearing from the device before giving up
+BIN_RETRIES = 10
+
+FLASH_BOOTLOADER_ORIGIN = 0x10000000
+FLASH_HEADER_ORIGIN = 0x10009000
+FLASH_MAIN_ORIGIN = 0x1000A000
+FLASH_HEADER_CRC_OFFSET = 4
+SECTOR_SIZE = 4096
+
+BIN_RESUME_ADDRESS = 0xFFFFFFFF
+
+HEADER = struct.Struct('<II')
+BODY = struct.Struct('<IH')
+
+
+def record(address: int, payload: bytes) -> bytes:
+    """A single record, an empty payload ends the image"""
+    body = BODY.pack(address, len(payload)) + payload
+    return HEADER.pack(BIN_MAGIC, binascii.crc32(body)) + body
+
+
+def records(image: bytes, origin: int = FLASH_BOOTLOADER_ORIGIN, resume: int = 0) -> List[bytes]:
+    """Records for the image from the flash header on, then the one that ends it
+
+    Args:
+        image (bytes): Flash contents from origin
+        origin (int): Flash address of the first byte of image
+        resume (int): Sectors from the start of the program that are already written, the header is always sent
+
+    Returns:
+        List[bytes]: Records in the order they are sent
+    """
+    start = FLASH_HEADER_ORIGIN - origin
+    kept = FLASH_MAIN_ORIGIN + resume * SECTOR_SIZE
+    out = [record(origin + offset, image[offset:offset + BIN_PAYLOAD_MAX]) for offset in range(start, len(image), BIN_PAYLOAD_MAX)
+           if not FLASH_MAIN_ORIGIN <= origin + offset < kept]
+    out.append(record(0, b''))
+    return out
+
+
+def program_id(image: bytes, origin: int = FLASH_BOOTLOADER_ORIGIN) -> Optional[Tuple[int, int]]:
+    """CRC32 and size of the program as recorded in the image's flash header, None if there is no header"""
+    offset = FLASH_HEADER_ORIGIN + FLASH_HEADER_CRC_OFFSET - origin
+    if offset < 0 or offset + 8 > len(image):
+        return None
+    return struct.unpack_from('<II', image, offset)
+
+
+def resume(ser: serial.Serial, crc: int, size: int) -> int:
+    """Ask how many sectors of the program a transfer that was cut short wrote
+
+    The query is sent like any other record, the device prompts again for the next one once it has answered.
+    """
+    ser.write(record(BIN_RESUME_ADDRESS, struct.pack('<II', crc, size)))
+    while True:
+        reply = ser.read(1)
+        if not reply or reply[0] == BIN_FAIL:
+            raise serial.serialutil.SerialException("No answer to the resume query")
+        if reply[0] == BIN_ACK:
+            break
+        # A prompt that was already on its way, or whatever was left over from before the bootloader took over
+
+    count = ser.read(4)
+    if len(count) != 4:
+        raise serial.serialutil.SerialException("No answer to the resume query")
+    return struct.unpack('<I', count)[0]
+
+
+def serial_output(port: str, bin_file: str, baudrate: int = 9600):
+    """Flash to a Serial port given the port name and bin file
+
+    Args:
+        port (str): Port name of the device to flash
+        bin_file (str): Path to the compiled _OUT.bin file
+        baudrate (int): Baud rate for a bootloader built with the UART transport, USB ignores it
+    """
+
+    # Serial port configurations
+    ser = serial.Serial(
+        port=port,
+        baudrate=baudrate,
+        parity=serial.PARITY_NONE,
+        stopbits=serial.STOPBITS_ONE,
+        bytesize=serial.EIGHTBITS,
+        timeout=0.5
+    )
+
+    ser.write(b'DEBUG')
+
+    time.sleep(2.2)
+
+    ser.close()
+    ser.open()
+    ser.reset_input_buffer()
+
+    with open(bin_file, 'rb') as file:
+        image = file.read()
+
+    # Carry on from where an earlier transfer of the same program was cut short
+    done = 0
+    program = program_id(image)
+    if program:
+        while ser.read(1) not in (bytes([BIN_READY]), b''):
+            pass
+        done = resume(ser, *program)
+        if done:
+            print(f"Resuming after {done} sectors")
+    recs = records(image, resume=done)
+
+    start = time.monotonic()
+    for index, rec in enumerate(recs):
+        retries = 0
+        while True:
+            reply = ser.read(1)
+            if not reply:
+                retries += 1
+                if retries > BIN_RETRIES:
+                    raise serial.serialutil.SerialException("Device stopped responding")
+                ser.write(rec)
+            elif reply[0] == BIN_READY:
+                ser.write(rec)
+            elif reply[0] == BIN_ACK:
+                break
+            elif reply[0] == BIN_FAIL:
+                raise serial.serialutil.SerialException(f"Device rejected record {index}")
+            # Anything else was left over from before the bootloader took over
+
+        print(f"{((index + 1) / len(recs)) * 100:.2f}%{' ' * 10}", end="\r")
+
+    elapsed = time.monotonic() - start
+    total = sum(len(rec) for rec in recs)
+    print(f"Sent {total} bytes in {elapsed:.2f}s ({total / elapsed / 1024:.1f} KiB/s){' ' * 10}")
+
+    ser.close()
+
+
+if __name__ == "__main__":
+    try:
+        serial_output(sys.argv[1] if len(sys.argv) > 1 else 'COM16', sys.argv[2] if len(sys.argv) > 2 else './build/PMPi_OUT.bin',
+                      int(sys.argv[3]) if len(sys.argv) > 3 else 9600)
+    except serial.serialutil.SerialException as pe:
+        print(f"SERIAL FAILED {pe}{' '*50}")
@@ -0,0 +1,418 @@
+"""Serial flashing using windowed binary frames over USB STDIO
+
+Frame layout (little-endian), see include/frame.h:
+    magic u32 | seq u16 | type u8 | flags u8 | address u32 | length u16 | reserved u16 | payload | crc32 u32
+
+Up to `window` frames are kept in flight. The device ACKs cumulatively as frames are written
+and NAKs the first missing frame, which is the only one that gets resent.
+
+Image data is sent LZ compressed in ZDATA frames, see lz.py.
+
+A transfer that was cut short is carried on with the sectors the device journalled as written, see RESUME.
+"""
+import binascii
+import struct
+import sys
+import time
+from typing import Iterable, List, Optional, Tuple
+
+import serial
+
+from lz import Encoder
+
+FRAME_MAGIC = 0x52464D50
+FRAME_REPLY_SYNC = 0x5A
+
+FRAME_HELLO = 0x01
+FRAME_DATA = 0x02
+FRAME_END = 0x03
+FRAME_QUERY = 0x04
+FRAME_ZDATA = 0x05
+FRAME_SECTOR = 0x06
+FRAME_ERASE = 0x07
+FRAME_RESUME = 0x08
+
+FRAME_ACK = 0x06
+FRAME_NAK = 0x15
+FRAME_FAIL = 0x18
+
+SECTOR_SIZE = 4096
+FRAME_INFLATED_MAX = 32768
+
+FLASH_HEADER_ORIGIN = 0x10009000
+FLASH_MAIN_ORIGIN = 0x1000A000
+FLASH_HEADER_CRC_OFFSET = 4
+
+HEADER = struct.Struct('<IHBBIHH')
+REPLY = struct.Struct('<BBHI')
+
+
+def parse_hex(lines: Iterable[str]) -> List[Tuple[int, bytearray]]:
+    """Parse the lines of an Intel HEX file into contiguous segments
+
+    Args:
+        lines (Iterable[str]): Lines of the file, anything that is not a record is skipped
+
+    Returns:
+        List[Tuple[int, bytearray]]: (address, data) of each contiguous segment, sorted by address
+    """
+    segments: List[Tuple[int, bytearray]] = []
+    upper = 0
+
+    for line in lines:
+        line = line.strip()
+        if not line.startswith(':'):
+            continue
+        record = bytes.fromhex(line[1:])
+        count, address, rtype = record[0], (record[1] << 8) | record[2], record[3]
+        data = record[4:4 + count]
+        if rtype == 0x00:
+            address += upper
+            if segments and segments[-1][0] + len(segments[-1][1]) == address:
+                segments[-1][1].extend(data)
+            else:
+                segments.append((address, bytearray(data)))
+        elif rtype == 0x04:
+            upper = ((data[0] << 8) | data[1]) << 16
+        elif rtype == 0x01:
+            break
+
+    segments.sort(key=lambda s: s[0])
+    return segments
+
+
+def read_hex(hex_file: str) -> List[Tuple[int, bytearray]]:
+    """Read an Intel HEX file into contiguous segments
+
+    Args:
+        hex_file (str): Path to the compiled .hex file
+
+    Returns:
+        List[Tuple[int, bytearray]]: (address, data) of each contiguous segment, sorted by address
+    """
+    with open(hex_file, 'r', encoding='utf-8') as file:
+        return parse_hex(file)
+
+
+def clip_segments(segments: List[Tuple[int, bytearray]]) -> List[Tuple[int, bytearray]]:
+    """Drop everything below the flash header, the bootloader never writes over itself"""
+    clipped = []
+    for address, data in segments:
+        skip = max(0, FLASH_HEADER_ORIGIN - address)
+        if skip < len(data):
+            clipped.append((address + skip, data[skip:]))
+    return clipped
+
+
+def fill_gaps(segments: List[Tuple[int, bytearray]]) -> List[Tuple[int, bytearray]]:
+    """Join segments into one, gaps read as erased flash the same as in imgtool's sector table"""
+    if not segments:
+        return []
+    segments = sorted(segments)
+    start = segments[0][0]
+    image = bytearray()
+    for address, data in segments:
+        offset = address - start
+        if offset > len(image):
+            image += b'\xff' * (offset - len(image))
+        image[offset:offset + len(data)] = data
+    return [(start, image)]
+
+
+def program_id(segments: List[Tuple[int, bytearray]]) -> Optional[Tuple[int, int]]:
+    """CRC32 and size of the program as recorded in the image's flash header, None if there is no header"""
+    for address, data in segments:
+        offset = FLASH_HEADER_ORIGIN + FLASH_HEADER_CRC_OFFSET - address
+        if 0 <= offset <= len(data) - 8:
+            return struct.unpack_from('<II', data, offset)
+    return None
+
+
+def drop_resumed(sectors: List[Tuple[int, bytes]], resume: int) -> List[Tuple[int, bytes]]:
+    """Leave out the sectors of the program a transfer that was cut short already wrote, the header is always sent"""
+    kept = FLASH_MAIN_ORIGIN + resume * SECTOR_SIZE
+    return [(address, data) for address, data in sectors if not FLASH_MAIN_ORIGIN <= address < kept]
+
+
+def merge_segments(chunks: List[Tuple[int, bytes]]) -> List[Tuple[int, bytearray]]:
+    """Join chunks that follow on from each other back into contiguous segments"""
+    merged: List[Tuple[int, bytearray]] = []
+    for address, data in chunks:
+        if merged and merged[-1][0] + len(merged[-1][1]) == address:
+            merged[-1][1].extend(data)
+        else:
+            merged.append((address, bytearray(data)))
+    return merged
+
+
+def build_frame(seq: int, ftype: int, address: int = 0, payload: bytes = b'', extent: int = 0) -> bytes:
+    """Build a single frame including its trailing CRC32"""
+    raw = HEADER.pack(FRAME_MAGIC, seq & 0xFFFF, ftype, 0, address, len(payload), extent) + payload
+    return raw + struct.pack('<I', binascii.crc32(raw))
+
+
+def split_segments(segments: List[Tuple[int, bytearray]], payload_max: int) -> List[Tuple[int, bytes]]:
+    """Split segments into frame payloads that never cross a sector boundary"""
+    chunks = []
+    for address, data in segments:
+        offset = 0
+        while offset < len(data):
+            start = address + offset
+            room = min(payload_max, SECTOR_SIZE - (start % SECTOR_SIZE))
+            chunks.append((start, bytes(data[offset:offset + room])))
+            offset += room
+    return chunks
+
+
+def erase_runs(chunks: List[Tuple[int, bytes]]) -> List[Tuple[int, int]]:
+    """(address, sector count) of every run of consecutive program sectors the chunks will be written to"""
+    runs: List[List[int]] = []
+    for address, _ in chunks:
+        if address < FLASH_MAIN_ORIGIN:
+            continue
+        sector = address - (address % SECTOR_SIZE)
+        if runs and runs[-1][0] + runs[-1][1] * SECTOR_SIZE == sector:
+            runs[-1][1] += 1
+        elif not runs or runs[-1][0] + (runs[-1][1] - 1) * SECTOR_SIZE != sector:
+            runs.append([sector, 1])
+    return [(address, count) for address, count in runs]
+
+
+def compress_segments(segments: List[Tuple[int, bytearray]], payload_max: int) -> List[Tuple[int, int, bytes, int]]:
+    """Compress segments into ZDATA frames
+
+    The device keeps its decompression history across frames, so the segments are compressed as one
+    stream in the order the frames are sent.
+
+    Returns:
+        List[Tuple[int, int, bytes, int]]: (type, address, payload, inflated) of each frame in order
+    """
+    encoder = Encoder(b''.join(bytes(data) for _, data in segments))
+    frames = []
+    stream = 0
+    for address, data in segments:
+        end = stream + len(data)
+        while encoder.pos < end:
+            start = address + encoder.pos - stream
+            block, inflated = encoder.block(min(end, encoder.pos + FRAME_INFLATED_MAX), payload_max)
+            frames.append((FRAME_ZDATA, start, block, inflated))
+        stream = end
+    return frames
+
+
+class FrameLink:
+    """Windowed frame sender over a serial port"""
+
+    def __init__(self, ser: serial.Serial, timeout: float = 0.5):
+        self.ser = ser
+        self.timeout = timeout
+        self.window = 1
+        self.payload_max = SECTOR_SIZE
+        self.seq = 0
+        self.progress = True  # Print how far along queries and sends are
+
+    def reply(self) -> Optional[Tuple[int, int, int]]:
+        """Read a single reply, returns None on timeout"""
+        # Whatever an app still running prints is skipped, but only for so long
+        deadline = time.monotonic() + self.timeout
+        while time.monotonic() < deadline:
+            sync = self.ser.read(1)
+            if not sync:
+                return None
+            if sync[0] != FRAME_REPLY_SYNC:
+                continue
+            rest = self.ser.read(REPLY.size - 1)
+            if len(rest) != REPLY.size - 1:
+                return None
+            _, code, seq, value = REPLY.unpack(sync + rest)
+            return code, seq, value
+        return None
+
+    def hello(self, attempts: int = 20) -> None:
+        """Start a session, learning the device's window and payload size"""
+        for _ in range(attempts):
+            self.ser.write(build_frame(self.seq, FRAME_HELLO))
+            r = self.reply()
+            if r and r[0] == FRAME_ACK and r[1] == self.seq:
+                self.window = max(1, r[2] >> 16)
+                self.payload_max = r[2] & 0xFFFF
+                self.seq += 1
+                return
+        raise serial.serialutil.SerialException("No reply to HELLO")
+
+    def query(self, attempts: int = 5) -> Optional[int]:
+        """CRC32 of the program currently in flash, None if it does not verify"""
+        for _ in range(attempts):
+            self.ser.write(build_frame(self.seq, FRAME_QUERY))
+            r = self.reply()
+            if r and r[1] == self.seq:
+                return r[2] if r[0] == FRAME_ACK else None
+        raise serial.serialutil.SerialException("No reply to QUERY")
+
+    def resume(self, crc: int, size: int, attempts: int = 5) -> int:
+        """Sectors of the program with this CRC32 and size that a transfer cut short already wrote"""
+        for _ in range(attempts):
+            self.ser.write(build_frame(self.seq, FRAME_RESUME, 0, struct.pack('<II', crc, size)))
+            r = self.reply()
+            if r and r[1] == self.seq:
+                return r[2] if r[0] == FRAME_ACK else 0
+        raise serial.serialutil.SerialException("No reply to RESUME")
+
+    def sector_crcs(self, sectors: List[Tuple[int, bytes]], attempts: int = 5) -> List[Optional[int]]:
+        """CRC32 of what flash currently holds for each (address, data), None where the device refused
+
+        Queries are answered straight away rather than written, so `window` of them are kept in flight.
+        """
+        first_seq = self.seq
+        wire = [build_frame(first_seq + i, FRAME_SECTOR, a, b'', len(d)) for i, (a, d) in enumerate(sectors)]
+        crcs: List[Optional[int]] = [None] * len(wire)
+        todo = list(range(len(wire)))
+
+        for _ in range(attempts):
+            missed = []
+            for start in range(0, len(todo), self.window):
+                batch = todo[start:start + self.window]
+                for i in batch:
+                    self.ser.write(wire[i])
+
+                answered = set()
+                for _ in batch:
+                    r = self.reply()
+                    if r is None:
+                        break
+                    i = (r[1] - first_seq) & 0xFFFF
+                    if i in batch:
+                        answered.add(i)
+                        crcs[i] = r[2] if r[0] == FRAME_ACK else None
+                missed.extend(i for i in batch if i not in answered)
+
+                if self.progress:
+                    print(f"Comparing {(start / len(todo)) * 100:.2f}%{' ' * 10}", end="\r")
+
+            todo = missed
+            if not todo:
+                return crcs
+
+        raise serial.serialutil.SerialException("No reply to SECTOR")
+
+    def send(self, frames: List[Tuple]) -> None:
+        """Send frames keeping `window` in flight, resending only what the device asks for
+
+        Args:
+            frames (List[Tuple]): (type, address, payload[, extent]) of each frame in order
+        """
+        first_seq = self.seq
+        wire = [build_frame(first_seq + i, *frame) for i, frame in enumerate(frames)]
+        sent_at = [0.0] * len(wire)
+        base = 0
+        nxt = 0
+
+        while base < len(wire):
+            while nxt < len(wire) and nxt - base < self.window:
+                self.ser.write(wire[nxt])
+                sent_at[nxt] = time.monotonic()
+                nxt += 1
+
+            r = self.reply()
+            if r is None:
+                # Nothing heard back, assume the oldest frame was lost
+                if time.monotonic() - sent_at[base] > self.timeout:
+                    self.ser.write(wire[base])
+                    sent_at[base] = time.monotonic()
+                continue
+
+            code, seq, value = r
+            delta = (seq - (first_seq + base)) & 0xFFFF
+            if delta >= 0x8000:
+                delta -= 0x10000
+            idx = base + delta
+
+            if code == FRAME_ACK:
+                base = max(base, min(idx + 1, nxt))
+            elif code == FRAME_NAK:
+                if base <= idx < nxt:
+                    self.ser.write(wire[idx])
+                    sent_at[idx] = time.monotonic()
+            elif code == FRAME_FAIL:
+                if value:
+                    raise serial.serialutil.SerialException(f"Device rejected frame {seq}, flash page at {value:08x} would not program")
+                raise serial.serialutil.SerialException(f"Device rejected frame {seq}")
+
+            if self.progress:
+                print(f"{(base / len(wire)) * 100:.2f}%{' ' * 10}", end="\r")
+
+        self.seq = first_seq + len(wire)
+
+
+def serial_output(port: str, hex_file: str, baudrate: int = 9600):
+    """Flash to a Serial port given the port name and hex file
+
+    Args:
+        port (str): Port name of the device to flash
+        hex_file (str): Path to the compiled .hex file
+        baudrate (int): Baud rate for a bootloader built with the UART transport, USB ignores it
+    """
+
+    # Serial port configurations
+    ser = serial.Serial(
+        port=port,
+        baudrate=baudrate,
+        parity=serial.PARITY_NONE,
+        stopbits=serial.STOPBITS_ONE,
+        bytesize=serial.EIGHTBITS,
+        timeout=0.05
+    )
+
+    ser.write(b'DEBUG')
+
+    time.sleep(2.2)
+
+    ser.close()
+    ser.open()
+    ser.reset_input_buffer()
+
+    link = FrameLink(ser)
+    link.hello()
+
+    segments = fill_gaps(clip_segments(read_hex(hex_file)))
+    program = program_id(segments)
+    if program is not None and link.query() == program[0]:
+        # Already flashed, only tell the device to boot it
+        print(f"Image unchanged (CRC32 {program[0]:08x}){' ' * 10}")
+        link.send([(FRAME_END, 0, b'')])
+        ser.close()
+        return
+
+    # Carry on from where an earlier transfer of the same program was cut short
+    sectors = split_segments(segments, SECTOR_SIZE)
+    done = link.resume(*program) if program is not None else 0
+    if done:
+        print(f"Resuming after {done} sectors{' ' * 10}")
+        sectors = drop_resumed(sectors, done)
+
+    # Only send the sectors that differ from what is already in flash
+    flashed = link.sector_crcs(sectors)
+    stale = [(address, data) for (address, data), crc in zip(sectors, flashed) if crc != binascii.crc32(data)]
+    print(f"{len(stale)} of {len(sectors)} sectors differ{' ' * 10}")
+
+    # Erase everything that is about to be written up front, the device uses block erases where it can
+    frames = [(FRAME_ERASE, address, b'', count) for address, count in erase_runs(stale)]
+    frames += compress_segments(merge_segments(stale), link.payload_max)
+    frames.append((FRAME_END, 0, b''))
+
+    start = time.monotonic()
+    link.send(frames)
+    elapsed = time.monotonic() - start
+    total = sum(len(data) for _, data in stale)
+    sent = sum(len(frame[2]) for frame in frames)
+    print(f"Sent {total} bytes as {sent} in {elapsed:.2f}s ({total / elapsed / 1024:.1f} KiB/s){' ' * 10}")
+
+    ser.close()
+
+
+if __name__ == "__main__":
+    try:
+        serial_output(sys.argv[1] if len(sys.argv) > 1 else 'COM16', sys.argv[2] if len(sys.argv) > 2 else './build/PMPi_OUT.hex',
+                      int(sys.argv[3]) if len(sys.argv) > 3 else 9600)
+    except serial.serialutil.SerialException as pe:
+        print(f"SERIAL FAILED {pe}{' '*50}")
@@ -0,0 +1,77 @@
+/**
+ * @file elf_file.hpp
+ * @author IR
+ * @brief Header file for reading the 32 bit little-endian ELF files the Pico toolchain links
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace imgtool {
+
+    /**
+     * @brief A section of the ELF file as the image needs it
+     */
+    struct Section {
+        std::string name;
+        uint32_t address; // Where it is at run time (VMA)
+        uint32_t load;    // Where it is stored, in flash for initialized data (LMA)
+        uint32_t offset;  // Of its contents in the file
+        uint32_t size;
+        bool loaded;      // Allocated and has contents, the sections objcopy outputs
+    };
+
+    /**
+     * @brief An ELF file read into memory once, its sections may be changed in place and saved again
+     */
+    class ElfFile {
+    public:
+        /**
+         * @brief Read and check an ELF file
+         *
+         * @param path File to read
+         * @throw std::runtime_error The file could not be read or is not a 32 bit little-endian ELF
+         */
+        explicit ElfFile(const std::string &path);
+
+        /**
+         * @brief Find a section by name
+         *
+         * @param name Section name, including the leading '.'
+         * @return const Section* The section, nullptr if there is none by that name
+         */
+        const Section *find(const std::string &name) const;
+
+        /**
+         * @brief Contents of a loaded section, writable so it can be filled in post-build
+         */
+        std::span<uint8_t> contents(const Section &section);
+        std::span<const uint8_t> contents(const Section &section) const;
+
+        /**
+         * @brief Write the file out again, including any changes made to its sections
+         *
+         * @param path File to write
+         * @throw std::runtime_error The file could not be written
+         */
+        void save(const std::string &path) const;
+
+        const std::vector<Section> &sections() const { return sections_; }
+        uint32_t entry() const { return entry_; }
+
+    private:
+        std::vector<uint8_t> raw;
+        std::vector<Section> sections_;
+        uint32_t entry_;
+    };
+
+} // namespace imgtool
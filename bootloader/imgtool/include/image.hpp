@@ -0,0 +1,116 @@
+/**
+ * @file image.hpp
+ * @author IR
+ * @brief Header file for the flash image built from an ELF file and the outputs written from it
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "elf_file.hpp"
+
+namespace imgtool {
+
+    // RP2040 XIP window, anything loaded outside of it is not part of the flash image
+    constexpr uint32_t XIP_BASE = 0x10000000;
+    constexpr uint32_t XIP_LENGTH = 16 * 1024 * 1024;
+
+    // Flash header layout, see bootloader_config.h. Version 2 adds a CRC32 for every sector of the program.
+    constexpr uint32_t HEADER_MAGIC = 0xEFBEADDE; // DEADBEEF in ihex
+    constexpr uint32_t HEADER_VERSION = 2;
+    constexpr uint32_t SECTOR_SIZE = 4096;
+
+    constexpr uint8_t ERASED = 0xFF;
+
+    /**
+     * @brief A contiguous run of flash
+     */
+    struct Segment {
+        uint32_t address;
+        std::vector<uint8_t> data;
+
+        uint32_t end() const { return address + data.size(); }
+    };
+
+    /**
+     * @brief What the flash header holds for a program
+     */
+    struct Header {
+        uint32_t vtor;
+        uint32_t crc;
+        uint32_t size;
+        std::vector<uint32_t> sector_crcs;
+
+        /**
+         * @brief The header as it is stored, padded to length as erased flash
+         *
+         * @throw std::runtime_error The sector table does not fit in length
+         */
+        std::vector<uint8_t> bytes(uint32_t length) const;
+    };
+
+    /**
+     * @brief Flash contents, sorted by address with adjoining runs merged
+     */
+    class Image {
+    public:
+        /**
+         * @brief Everything the ELF file stores in flash, at its load address
+         */
+        explicit Image(const ElfFile &elf);
+
+        /**
+         * @brief Header for the program in [origin, origin + length)
+         * @details Gaps before and between the program's segments read as erased flash, as they do once flashed.
+         * The program's size runs to the end of its last segment.
+         */
+        Header header(uint32_t origin, uint32_t length) const;
+
+        /**
+         * @brief Flash from the first segment to the end of the last, gaps filled as erased flash
+         */
+        std::vector<uint8_t> flat() const;
+
+        const std::vector<Segment> &segments() const { return segments_; }
+
+    private:
+        std::vector<Segment> segments_;
+    };
+
+    /**
+     * @brief CRC32 as zlib and the bootloader's DMA sniffer compute it
+     */
+    uint32_t crc32(std::span<const uint8_t> data, uint32_t crc = 0);
+
+    /**
+     * @brief Write the image as Intel HEX, 16 bytes a record the same as objcopy
+     *
+     * @throw std::runtime_error The file could not be written
+     */
+    void write_hex(const std::string &path, const Image &image, uint32_t entry);
+
+    /**
+     * @brief Write bytes to a file
+     *
+     * @throw std::runtime_error The file could not be written
+     */
+    void write_bin(const std::string &path, std::span<const uint8_t> data);
+
+    /**
+     * @brief Write an assembly file that includes a binary file as a section of its own
+     * @details The binary's CRC32 is part of the file, so the assembly changes whenever the binary does
+     *
+     * @throw std::runtime_error The file could not be written
+     */
+    void write_asm(const std::string &path, const std::string &bin_path, std::span<const uint8_t> data, const std::string &section, const std::string &attributes);
+
+} // namespace imgtool
@@ -0,0 +1,159 @@
+/**
+ * @file elf_file.cpp
+ * @author IR
+ * @brief Source file for reading the 32 bit little-endian ELF files the Pico toolchain links
+ * @details Only what the image needs is read, the section headers and the program headers that give each
+ * section its load address. <elf.h> is not there on every host, so the few structures used are defined here.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "elf_file.hpp"
+
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace imgtool {
+
+    static_assert(std::endian::native == std::endian::little, "ELF files are read in place, the host has to be little-endian");
+
+    namespace {
+
+        constexpr uint8_t ELFMAG[] = {0x7f, 'E', 'L', 'F'};
+        constexpr uint8_t ELFCLASS32 = 1;
+        constexpr uint8_t ELFDATA2LSB = 1;
+        constexpr uint32_t PT_LOAD = 1;
+        constexpr uint32_t SHT_NOBITS = 8;
+        constexpr uint32_t SHF_ALLOC = 0x2;
+
+        struct Elf32_Ehdr {
+            uint8_t e_ident[16];
+            uint16_t e_type;
+            uint16_t e_machine;
+            uint32_t e_version;
+            uint32_t e_entry;
+            uint32_t e_phoff;
+            uint32_t e_shoff;
+            uint32_t e_flags;
+            uint16_t e_ehsize;
+            uint16_t e_phentsize;
+            uint16_t e_phnum;
+            uint16_t e_shentsize;
+            uint16_t e_shnum;
+            uint16_t e_shstrndx;
+        };
+
+        struct Elf32_Phdr {
+            uint32_t p_type;
+            uint32_t p_offset;
+            uint32_t p_vaddr;
+            uint32_t p_paddr;
+            uint32_t p_filesz;
+            uint32_t p_memsz;
+            uint32_t p_flags;
+            uint32_t p_align;
+        };
+
+        struct Elf32_Shdr {
+            uint32_t sh_name;
+            uint32_t sh_type;
+            uint32_t sh_flags;
+            uint32_t sh_addr;
+            uint32_t sh_offset;
+            uint32_t sh_size;
+            uint32_t sh_link;
+            uint32_t sh_info;
+            uint32_t sh_addralign;
+            uint32_t sh_entsize;
+        };
+
+        // Copy a structure out of the file, checking it is all there
+        template <typename T>
+        T read(const std::vector<uint8_t> &raw, uint64_t offset) {
+            if (offset + sizeof(T) > raw.size())
+                throw std::runtime_error("truncated ELF file");
+            T out;
+            std::memcpy(&out, raw.data() + offset, sizeof(T));
+            return out;
+        }
+
+    } // namespace
+
+    ElfFile::ElfFile(const std::string &path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            throw std::runtime_error("could not open " + path);
+        raw.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+        auto ehdr = read<Elf32_Ehdr>(raw, 0);
+        if (std::memcmp(ehdr.e_ident, ELFMAG, sizeof(ELFMAG)) || (ehdr.e_ident[4] != ELFCLASS32) || (ehdr.e_ident[5] != ELFDATA2LSB))
+            throw std::runtime_error(path + " is not a 32 bit little-endian ELF file");
+        entry_ = ehdr.e_entry;
+
+        std::vector<Elf32_Phdr> segments;
+        for (uint16_t i = 0; i < ehdr.e_phnum; i++) {
+            auto phdr = read<Elf32_Phdr>(raw, ehdr.e_phoff + uint64_t(i) * ehdr.e_phentsize);
+            if (phdr.p_type == PT_LOAD)
+                segments.push_back(phdr);
+        }
+
+        auto strtab = read<Elf32_Shdr>(raw, ehdr.e_shoff + uint64_t(ehdr.e_shstrndx) * ehdr.e_shentsize);
+        for (uint16_t i = 0; i < ehdr.e_shnum; i++) {
+            auto shdr = read<Elf32_Shdr>(raw, ehdr.e_shoff + uint64_t(i) * ehdr.e_shentsize);
+
+            Section section{};
+            uint64_t name = uint64_t(strtab.sh_offset) + shdr.sh_name;
+            if (name < raw.size())
+                section.name.assign(reinterpret_cast<const char *>(raw.data() + name), strnlen(reinterpret_cast<const char *>(raw.data() + name), raw.size() - name));
+            section.address = section.load = shdr.sh_addr;
+            section.offset = shdr.sh_offset;
+            section.size = shdr.sh_size;
+            section.loaded = (shdr.sh_flags & SHF_ALLOC) && (shdr.sh_type != SHT_NOBITS) && shdr.sh_size;
+
+            if (section.loaded) {
+                if (uint64_t(shdr.sh_offset) + shdr.sh_size > raw.size())
+                    throw std::runtime_error("truncated section " + section.name);
+
+                // Stored wherever the segment holding it is loaded, .data is run from RAM but stored in flash
+                for (const auto &seg : segments) {
+                    if ((shdr.sh_offset >= seg.p_offset) && (uint64_t(shdr.sh_offset) + shdr.sh_size <= uint64_t(seg.p_offset) + seg.p_filesz)) {
+                        section.load = seg.p_paddr + (shdr.sh_offset - seg.p_offset);
+                        break;
+                    }
+                }
+            }
+
+            sections_.push_back(std::move(section));
+        }
+    }
+
+    const Section *ElfFile::find(const std::string &name) const {
+        for (const auto &section : sections_) {
+            if (section.name == name)
+                return &section;
+        }
+        return nullptr;
+    }
+
+    std::span<uint8_t> ElfFile::contents(const Section &section) {
+        return {raw.data() + section.offset, section.loaded ? section.size : 0};
+    }
+
+    std::span<const uint8_t> ElfFile::contents(const Section &section) const {
+        return {raw.data() + section.offset, section.loaded ? section.size : 0};
+    }
+
+    void ElfFile::save(const std::string &path) const {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(raw.data()), raw.size());
+        if (!file)
+            throw std::runtime_error("could not write " + path);
+    }
+
+} // namespace imgtool
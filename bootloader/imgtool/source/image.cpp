@@ -0,0 +1,195 @@
+/**
+ * @file image.cpp
+ * @author IR
+ * @brief Source file for the flash image built from an ELF file and the outputs written from it
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "image.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace imgtool {
+
+    namespace {
+
+        constexpr std::array<uint32_t, 256> crc_table = [] {
+            std::array<uint32_t, 256> table{};
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+                table[i] = c;
+            }
+            return table;
+        }();
+
+        void put32(std::vector<uint8_t> &out, uint32_t value) {
+            for (int i = 0; i < 4; i++)
+                out.push_back(value >> (8 * i));
+        }
+
+        void put_hex(std::string &out, uint8_t byte) {
+            constexpr char digits[] = "0123456789ABCDEF";
+            out.push_back(digits[byte >> 4]);
+            out.push_back(digits[byte & 0xF]);
+        }
+
+        // Single Intel HEX record, checksum included, with the CRLF objcopy ends lines with
+        void hex_record(std::string &out, uint8_t type, uint16_t address, std::span<const uint8_t> data) {
+            const uint8_t fields[] = {uint8_t(data.size()), uint8_t(address >> 8), uint8_t(address), type};
+            uint8_t sum = 0;
+
+            out.push_back(':');
+            for (uint8_t byte : fields) {
+                put_hex(out, byte);
+                sum += byte;
+            }
+            for (uint8_t byte : data) {
+                put_hex(out, byte);
+                sum += byte;
+            }
+            put_hex(out, -sum);
+            out += "\r\n";
+        }
+
+    } // namespace
+
+    uint32_t crc32(std::span<const uint8_t> data, uint32_t crc) {
+        crc = ~crc;
+        for (uint8_t byte : data)
+            crc = crc_table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    std::vector<uint8_t> Header::bytes(uint32_t length) const {
+        std::vector<uint8_t> out;
+        put32(out, vtor);
+        put32(out, crc);
+        put32(out, size);
+        put32(out, HEADER_MAGIC);
+        put32(out, HEADER_VERSION);
+        put32(out, sector_crcs.size());
+        for (uint32_t sector : sector_crcs)
+            put32(out, sector);
+
+        if (out.size() > length)
+            throw std::runtime_error("program is too large for the flash header (" + std::to_string(sector_crcs.size()) + " sectors)");
+
+        out.resize(length, ERASED);
+        return out;
+    }
+
+    Image::Image(const ElfFile &elf) {
+        for (const auto &section : elf.sections()) {
+            if (!section.loaded || (section.load < XIP_BASE) || (section.load - XIP_BASE >= XIP_LENGTH))
+                continue;
+            auto contents = elf.contents(section);
+            segments_.push_back({section.load, {contents.begin(), contents.end()}});
+        }
+
+        std::sort(segments_.begin(), segments_.end(), [](const Segment &a, const Segment &b) { return a.address < b.address; });
+
+        // Sections laid out back to back become one run
+        std::vector<Segment> merged;
+        for (auto &segment : segments_) {
+            if (!merged.empty() && (merged.back().end() > segment.address))
+                throw std::runtime_error("sections overlap in flash");
+            if (!merged.empty() && (merged.back().end() == segment.address))
+                merged.back().data.insert(merged.back().data.end(), segment.data.begin(), segment.data.end());
+            else
+                merged.push_back(std::move(segment));
+        }
+        segments_ = std::move(merged);
+    }
+
+    Header Image::header(uint32_t origin, uint32_t length) const {
+        std::vector<uint8_t> program;
+
+        for (const auto &segment : segments_) {
+            if ((segment.end() <= origin) || (segment.address >= origin + length))
+                continue;
+
+            uint32_t start = std::max(segment.address, origin);
+            uint32_t end = std::min(segment.end(), origin + length);
+            program.resize(end - origin, ERASED);
+            std::copy(segment.data.begin() + (start - segment.address), segment.data.begin() + (end - segment.address), program.begin() + (start - origin));
+        }
+
+        // One CRC32 per sector, the last one only covers what is left of the program
+        Header header{origin, crc32(program), uint32_t(program.size()), {}};
+        for (size_t offset = 0; offset < program.size(); offset += SECTOR_SIZE)
+            header.sector_crcs.push_back(crc32(std::span(program).subspan(offset, std::min<size_t>(SECTOR_SIZE, program.size() - offset))));
+        return header;
+    }
+
+    std::vector<uint8_t> Image::flat() const {
+        if (segments_.empty())
+            return {};
+
+        std::vector<uint8_t> out(segments_.back().end() - segments_.front().address, ERASED);
+        for (const auto &segment : segments_)
+            std::copy(segment.data.begin(), segment.data.end(), out.begin() + (segment.address - segments_.front().address));
+        return out;
+    }
+
+    void write_hex(const std::string &path, const Image &image, uint32_t entry) {
+        std::string out;
+        int32_t upper = -1;
+
+        for (const auto &segment : image.segments()) {
+            for (uint32_t offset = 0; offset < segment.data.size();) {
+                uint32_t address = segment.address + offset;
+
+                if (int32_t(address >> 16) != upper) {
+                    upper = address >> 16;
+                    const uint8_t ela[] = {uint8_t(upper >> 8), uint8_t(upper)};
+                    hex_record(out, 0x04, 0, ela);
+                }
+
+                // Records stop short of the next 64K boundary
+                uint32_t count = std::min({uint32_t(16), uint32_t(segment.data.size() - offset), 0x10000 - (address & 0xFFFF)});
+                hex_record(out, 0x00, address, std::span(segment.data).subspan(offset, count));
+                offset += count;
+            }
+        }
+
+        const uint8_t start[] = {uint8_t(entry >> 24), uint8_t(entry >> 16), uint8_t(entry >> 8), uint8_t(entry)};
+        hex_record(out, 0x05, 0, start);
+        hex_record(out, 0x01, 0, {});
+
+        write_bin(path, {reinterpret_cast<const uint8_t *>(out.data()), out.size()});
+    }
+
+    void write_bin(const std::string &path, std::span<const uint8_t> data) {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(data.data()), data.size());
+        if (!file)
+            throw std::runtime_error("could not write " + path);
+    }
+
+    void write_asm(const std::string &path, const std::string &bin_path, std::span<const uint8_t> data, const std::string &section, const std::string &attributes) {
+        char crc[16];
+        std::snprintf(crc, sizeof(crc), "%08X", unsigned(crc32(data)));
+
+        std::ofstream file(path);
+        file << "// Generated assembly file from: " << bin_path << "\n";
+        file << "// " << data.size() << " bytes, CRC32 " << crc << "\n\n";
+        file << ".cpu cortex-m0plus\n";
+        file << ".thumb\n\n";
+        file << ".section ." << section << ", \"" << attributes << "\"\n\n";
+        file << ".incbin \"" << bin_path << "\"\n";
+
+        if (!file)
+            throw std::runtime_error("could not write " + path);
+    }
+
+} // namespace imgtool
@@ -0,0 +1,83 @@
+/**
+ * @file main.cpp
+ * @author IR
+ * @brief Post-build image tool for the bootloader and the programs attached to it
+ * @details Reads an ELF file once and writes everything the build needs from it.
+ *
+ *     imgtool image PMPi.elf PMPi_OUT MAIN_ORIGIN MAIN_LENGTH
+ *         Fills in .flash_header for the program in [MAIN_ORIGIN, MAIN_ORIGIN + MAIN_LENGTH), then writes
+ *         PMPi_OUT.elf, PMPi_OUT.hex and PMPi_OUT.bin, the flash image from its first address for the BIN scheme
+ *
+ *     imgtool blob bootloader.elf bootloader.bin bootloader.S SECTION ATTRIBUTES
+ *         Writes the bootloader's flash image and an assembly file that places it in SECTION of the program
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "elf_file.hpp"
+#include "image.hpp"
+
+using namespace imgtool;
+
+static int usage(const char *name) {
+    std::fprintf(stderr,
+                 "usage: %s image IN.elf OUT_PREFIX MAIN_ORIGIN MAIN_LENGTH\n"
+                 "       %s blob IN.elf OUT.bin OUT.S SECTION ATTRIBUTES\n",
+                 name, name);
+    return 2;
+}
+
+static int image(const std::string &in, const std::string &out, uint32_t origin, uint32_t length) {
+    ElfFile elf(in);
+
+    const Section *section = elf.find(".flash_header");
+    if ((section == nullptr) || !section->loaded)
+        throw std::runtime_error(in + " has no .flash_header section to fill in");
+
+    Header header = Image(elf).header(origin, length);
+    auto bytes = header.bytes(section->size);
+    std::copy(bytes.begin(), bytes.end(), elf.contents(*section).begin());
+
+    // The image again, now with the header in it
+    Image flash(elf);
+    elf.save(out + ".elf");
+    write_hex(out + ".hex", flash, elf.entry());
+    write_bin(out + ".bin", flash.flat());
+
+    std::printf("Header VTOR:  0x%08x\n", unsigned(header.vtor));
+    std::printf("Header CRC32: 0x%08x\n", unsigned(header.crc));
+    std::printf("Header CRC32 SZ: %u\n", unsigned(header.size));
+    std::printf("Header sectors: %u\n", unsigned(header.sector_crcs.size()));
+    return 0;
+}
+
+static int blob(const std::string &in, const std::string &bin, const std::string &assembly, const std::string &section, const std::string &attributes) {
+    auto flat = Image(ElfFile(in)).flat();
+    write_bin(bin, flat);
+    write_asm(assembly, bin, flat, section, attributes);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    std::string command = (argc > 1) ? argv[1] : "";
+
+    try {
+        if ((command == "image") && (argc == 6))
+            return image(argv[2], argv[3], std::stoul(argv[4], nullptr, 0), std::stoul(argv[5], nullptr, 0));
+        if ((command == "blob") && (argc == 7))
+            return blob(argv[2], argv[3], argv[4], argv[5], argv[6]);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "imgtool: %s\n", e.what());
+        return 1;
+    }
+
+    return usage(argv[0]);
+}
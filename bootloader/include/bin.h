@@ -0,0 +1,69 @@
+/**
+ * @file bin.h
+ * @author IR
+ * @brief Header file for the raw binary input scheme
+ * @details The image is sent as records of raw bytes, each carrying its flash address, length and a CRC32, one
+ * record per round-trip like the HEX scheme. There is nothing to decode, so a record is about half the size of the
+ * same data as Intel HEX lines and goes almost straight into the flash buffers. The device prompts with BIN_Ready
+ * for a record, which the host sends again on every prompt until it is answered with BIN_Ack. A repeat of the last
+ * record written, sent by a host that missed its BIN_Ack, is acknowledged again without being written. A record
+ * with no payload ends the image.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// "PMBN" little-endian, marks the start of every record
+#define BIN_MAGIC 0x4E424D50u
+
+// Largest payload a single record may carry, one flash sector
+#define BIN_PAYLOAD_MAX 4096
+
+// A record for this address asks where a transfer was cut short, its payload is the CRC32 and size of the program.
+// It is ACKed with the number of sectors of the program that need not be sent again following, as a u32.
+#define BIN_RESUME_ADDRESS 0xFFFFFFFFu
+
+// Abandon a partially received record after this long without a byte
+#define BIN_BYTE_TIMEOUT_US 100000
+
+typedef enum BinReply {
+    BIN_Ready = 0x00, // Send the next record, or the last one again if it was not acknowledged
+    BIN_Ack = 0x01,   // The last record was written, or the image was committed for an ending record
+    BIN_Fail = 0x02,  // The last record can not be written or the image did not check out, loading is over
+} BinReply;
+
+/**
+ * @brief Header preceding every record payload
+ *
+ * @note The CRC32 covers everything after it, address and length included, up to the end of the payload
+ */
+typedef struct __attribute__((packed)) bin_header {
+    uint32_t magic;
+    uint32_t crc;
+    uint32_t address; // Flash address of the payload
+    uint16_t length;  // Bytes of payload, 0 ends the image
+} bin_header_t;
+
+/**
+ * @brief Initialize peripherals for this input scheme
+ */
+void bin_init(void);
+
+/**
+ * @brief Deinitialize peripherals for this input scheme
+ */
+void bin_deinit(void);
+
+/**
+ * @brief Receive records and write them to flash until the host ends the image
+ *
+ * @retval true Image was received and finalized
+ * @retval false A record could not be written or the image did not check out
+ */
+bool bin_load(void);
@@ -0,0 +1,126 @@
+/**
+ * @file boot_api.h
+ * @author IR
+ * @brief Header file for the service table the bootloader exports to the app
+ * @details Like the RP2040's ROM table, the bootloader leaves a versioned table of function pointers at a fixed
+ * address, the last 256 bytes of its flash region, so the app can erase and program flash, take CRC32s and check
+ * its image without linking code of its own for it. Nothing can execute from flash while it is being written, so
+ * the routines themselves are copied by the bootloader into the .boot_api_text region at the top of RAM, below the
+ * handoff block, right before it branches into the app. Both linker scripts reserve the region and the app never
+ * initializes it. Shared with the app, so everything here is header only.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// "BAPI" little-endian
+#define BOOT_API_MAGIC 0x49504142u
+#define BOOT_API_VERSION 2
+
+// Erase and program granularity of the routines below
+#define BOOT_API_SECTOR_SIZE 4096u
+#define BOOT_API_PAGE_SIZE 256u
+
+/**
+ * @brief Service table, only valid while boot_api_get() returns it
+ *
+ * @note Fields are only ever added at the end, with the version bumped
+ * @note The routines disable interrupts while flash is busy. The caller keeps the other core, if it runs, out of flash.
+ */
+typedef struct boot_api {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+
+    /**
+     * @brief Erase sectors of the program region and read them back as erased
+     *
+     * @param flash_offs Offset from the start of flash, sector aligned, no lower than the flash header
+     * @param count Bytes to erase, a multiple of BOOT_API_SECTOR_SIZE
+     * @retval true Range was erased
+     * @retval false Range is outside the program region, unaligned, or did not read back erased
+     */
+    bool (*flash_erase)(uint32_t flash_offs, uint32_t count);
+
+    /**
+     * @brief Program pages of the program region, each read back past the XIP cache and programmed again once if it did not take
+     *
+     * @param flash_offs Offset from the start of flash, page aligned, no lower than the flash header
+     * @param data Data to program, must not be in flash
+     * @param count Bytes to program, a multiple of BOOT_API_PAGE_SIZE
+     * @retval true Every page reads back as written
+     * @retval false Range is outside the program region, unaligned, or a page would not program
+     */
+    bool (*flash_program)(uint32_t flash_offs, const void *data, uint32_t count);
+
+    /**
+     * @brief CRC32 of a region of memory using the DMA sniffer, the same as zlib and the flash header
+     *
+     * @param channel DMA channel claimed by the caller, left idle
+     * @param src Start of the region, may be RAM or XIP flash
+     * @param len Length of the region in bytes
+     */
+    uint32_t (*crc32)(uint32_t channel, const void *src, uint32_t len);
+
+    /**
+     * @brief Check the program in flash against its flash header, as the bootloader does before branching into it
+     *
+     * @param channel DMA channel claimed by the caller, left idle
+     * @param sector Sector to start checking from, counted from the start of the program
+     * @return int32_t Index of the first sector at or after `sector` that does not match, -1 if they all do.
+     * A header without a sector table is checked against the CRC32 of the whole program, 0 is returned if it does not match.
+     */
+    int32_t (*image_check)(uint32_t channel, uint32_t sector);
+
+    /**
+     * @brief Check one sector of the program against the flash header's sector table, reading past the XIP cache
+     *
+     * @details For checking the program a little at a time while it runs, without evicting it from the XIP cache. Added in version 2.
+     *
+     * @param channel DMA channel claimed by the caller, left idle
+     * @param sector Sector counted from the start of the program
+     * @retval 1 Sector matches
+     * @retval 0 Sector does not match
+     * @retval -1 Sector is past the end of the program, or the header has no sector table
+     */
+    int32_t (*image_check_sector)(uint32_t channel, uint32_t sector);
+} boot_api_t;
+
+/**
+ * @brief The service table, placed by the linker at the end of the bootloader's flash region
+ */
+extern const boot_api_t __boot_api;
+
+/**
+ * @brief The service table if the bootloader in flash provides this version of it, NULL otherwise
+ */
+static inline const boot_api_t *boot_api_get(void) {
+    const volatile boot_api_t *api = &__boot_api;
+
+    if ((api->magic != BOOT_API_MAGIC) || (api->version < BOOT_API_VERSION) || (api->size < sizeof(boot_api_t)))
+        return NULL;
+
+    return &__boot_api;
+}
+
+/**
+ * @brief Copy the routines the table points at into RAM
+ *
+ * @note Bootloader only, called on the way into the app
+ */
+void boot_api_install(void);
+
+#ifdef __cplusplus
+}
+#endif
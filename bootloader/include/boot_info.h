@@ -0,0 +1,98 @@
+/**
+ * @file boot_info.h
+ * @author IR
+ * @brief Header file for the bootloader to app handoff block
+ * @details The block lives in the .boot_info section, which both linker scripts place at the end of RAM and which
+ * neither the bootloader nor the app initialize, so it survives watchdog resets. The bootloader records why it ran,
+ * which image it verified and how long each phase took. On a watchdog reset it skips verifying the image again if
+ * nothing has written flash since. Shared with the app, so everything here is header only.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// "BINF" little-endian
+#define BOOT_INFO_MAGIC 0x464E4942u
+#define BOOT_INFO_VERSION 2
+
+typedef enum BootReason {
+    BOOT_ReasonPowerOn = 0,   // Cold boot, RAM could not be trusted
+    BOOT_ReasonWatchdog = 1,  // Watchdog or software reset, e.g. mg_device_reset
+    BOOT_ReasonRequested = 2, // App asked for the bootloader through watchdog scratch[0]
+} BootReason;
+
+/**
+ * @brief Handoff block, only valid while boot_info_valid() holds
+ */
+typedef struct boot_info {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint32_t reason;              // BootReason of the last boot
+    uint32_t generation;          // Bumped whenever flash is written, by the bootloader or the app
+    uint32_t verified_generation; // Generation the image was last verified at
+    uint32_t image_crc;           // Flash header CRC32 of the verified image
+    uint32_t verify_us;           // Time spent verifying the image, 0 if it was trusted
+    uint32_t load_us;             // Time spent receiving and flashing a new image, 0 if none
+    uint32_t erase_us;            // Part of load_us spent erasing flash
+    uint32_t program_us;          // Part of load_us spent programming flash
+    uint32_t exit_us;             // Time since reset when the bootloader branched into the app
+    uint32_t checksum;            // Over everything above
+} boot_info_t;
+
+/**
+ * @brief The handoff block, placed by the linker
+ */
+extern boot_info_t __boot_info;
+
+static inline uint32_t boot_info_checksum(void) {
+    const uint32_t *word = (const uint32_t *)&__boot_info;
+    uint32_t sum = BOOT_INFO_MAGIC;
+
+    for (size_t i = 0; i < offsetof(boot_info_t, checksum) / sizeof(uint32_t); i++) {
+        sum = ((sum << 5) | (sum >> 27)) ^ word[i];
+    }
+
+    return sum;
+}
+
+/**
+ * @brief Whether the handoff block holds something written by the bootloader or app, rather than whatever RAM powered up with
+ */
+static inline bool boot_info_valid(void) {
+    return (__boot_info.magic == BOOT_INFO_MAGIC) && (__boot_info.version == BOOT_INFO_VERSION) && (__boot_info.size == sizeof(boot_info_t)) && (__boot_info.checksum == boot_info_checksum());
+}
+
+/**
+ * @brief Update the checksum after changing the handoff block
+ */
+static inline void boot_info_seal(void) {
+    __boot_info.checksum = boot_info_checksum();
+}
+
+/**
+ * @brief Note that flash is being written, the image has to be verified in full on the next boot
+ *
+ * @note The app must call this before erasing or programming flash
+ */
+static inline void boot_info_invalidate(void) {
+    if (boot_info_valid()) {
+        __boot_info.generation++;
+        boot_info_seal();
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
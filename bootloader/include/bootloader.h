@@ -46,11 +46,33 @@ bool bootloader_load_program(void);
 /**
  * @brief Returns whether the bootloader should run
  *
+ * @details Also starts the handoff block in boot_info.h. Verifying the program is skipped after a watchdog reset
+ * if the same image was verified before it and nothing has written flash since.
+ *
  * @retval true Invalid program loaded or manual entry set for bootloader
  * @retval false Valid program loaded, call bootloader_exit
  */
 bool bootloader_should_run(void);
 
+/**
+ * @brief Verify the program in flash against the CRC32 in the flash header
+ *
+ * @details Goes sector by sector with a version 2 header, stopping at the first corrupt one
+ *
+ * @retval true Program matches the flash header
+ * @retval false Program or flash header is invalid
+ */
+bool check_flash_crc32(void);
+
+/**
+ * @brief Find the next sector of the program that does not match its CRC32 in the flash header
+ *
+ * @param sector Sector to start checking from, counted from FLASH_MAIN_ORIGIN
+ * @return int32_t Index of the first corrupt sector at or after `sector`, -1 if they all match.
+ * `sector` itself is returned if the flash header has no sector table.
+ */
+int32_t check_flash_sectors(uint32_t sector);
+
 /**
  * @brief Triggers a soft reset
  *
@@ -22,6 +22,13 @@
 // Flash header offsets
 #define FLASH_HEADER_CRC_OFFSET 4
 #define FLASH_HEADER_CRC_SZ_OFFSET 8
+#define FLASH_HEADER_VERSION_OFFSET 16
+#define FLASH_HEADER_SECTORS_OFFSET 20
+#define FLASH_HEADER_TABLE_OFFSET 24
+
+// Flash header layout generated by imgtool. Version 2 adds a CRC32 for every sector of the program.
+// Headers without a version are only checked against the CRC32 of the whole program.
+#define FLASH_HEADER_VERSION 2
 
 // Application program offset in flash
 // This should agree with the linker script for the application program.
@@ -30,15 +37,52 @@
 //     #define FLASH_MAIN_ORIGIN
 // #endif
 
-#define BOOT_INPUT_HEX
+// Input scheme, normally selected through the BOOTLOADER_INPUT CMake cache variable
+// BOOT_INPUT_HEX: Intel HEX, one line per round-trip
+// BOOT_INPUT_FRAME: Windowed binary frames
+// BOOT_INPUT_BIN: Raw binary records, one per round-trip
+#if !defined(BOOT_INPUT_HEX) && !defined(BOOT_INPUT_FRAME) && !defined(BOOT_INPUT_ELF) && !defined(BOOT_INPUT_BIN)
+    #define BOOT_INPUT_HEX
+#endif
 
+// Where the scheme's input comes from
+// *_STREAM: The link selected by the transport below
 #if defined(BOOT_INPUT_HEX)
-    #define BOOT_INPUT_HEX_USB
+    #define BOOT_INPUT_HEX_STREAM
 // #define BOOT_INPUT_HEX_SPI_FLASH
+#elif defined(BOOT_INPUT_FRAME)
+    #define BOOT_INPUT_FRAME_STREAM
 #elif defined(BOOT_INPUT_ELF)
-    #define BOOT_INPUT_ELF_USB
+    #define BOOT_INPUT_ELF_STREAM
 // #define BOOT_INPUT_ELF_SPI_FLASH
 #elif defined(BOOT_INPUT_BIN)
-    #define BOOT_INPUT_BIN_USB
+    #define BOOT_INPUT_BIN_STREAM
 // #define BOOT_INPUT_BIN_SPI_FLASH
-#endif
\ No newline at end of file
+#endif
+
+// Transport, normally selected through the BOOTLOADER_TRANSPORT CMake cache variable
+// BOOT_TRANSPORT_USB: USB CDC
+// BOOT_TRANSPORT_UART: BOOT_UART, received through a DMA ring buffer
+#if !defined(BOOT_TRANSPORT_USB) && !defined(BOOT_TRANSPORT_UART)
+    #define BOOT_TRANSPORT_USB
+#endif
+
+#if defined(BOOT_TRANSPORT_UART)
+    #define BOOT_UART uart0
+    #define BOOT_UART_TX_PIN 0
+    #define BOOT_UART_RX_PIN 1
+
+    #ifndef BOOT_UART_BAUD
+        #define BOOT_UART_BAUD 3000000
+    #endif
+
+    // 32K ring, enough for a full FRAME_WINDOW of frames or 100ms of input at 3Mbaud while flash is busy
+    #define BOOT_UART_RING_BITS 15
+#endif
+
+// Schemes that always carry the complete program erase the sectors of the range described by its flash header
+// that do not match its sector table as soon as the header arrives, using block erases, instead of erasing sector
+// by sector while programming
+#if defined(BOOT_INPUT_HEX) || defined(BOOT_INPUT_BIN)
+    #define FLASH_ERASE_FROM_HEADER
+#endif
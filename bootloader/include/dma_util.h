@@ -19,3 +19,24 @@ static const char nil = 0;
 int dma_init(volatile void *write_addr, const volatile void *read_addr, uint transfer_count, enum dma_channel_transfer_size transfer_size, bool read_inc, bool write_inc);
 
 void dma_deinit(int handle);
+
+/**
+ * @brief Compute the CRC32 of a region of memory using the DMA sniffer
+ *
+ * @details Matches the CRC32 used by zlib/binascii (IEEE 802.3, reflected, inverted).
+ * The word aligned bulk of the region is read with 32-bit transfers, only the unaligned ends are read a byte at a time.
+ *
+ * @param src Start of the region to checksum, may be RAM or XIP flash
+ * @param len Length of the region in bytes
+ * @return uint32_t CRC32 of the region
+ */
+uint32_t dma_crc32(const volatile void *src, uint len);
+
+/**
+ * @brief Whether 32-bit transfers have to be fed to the sniffer byte swapped for dma_crc32's CRC32
+ *
+ * @details Worked out against a known CRC32 the first time it is needed, then remembered.
+ *
+ * @return bool Whether the sniffer's byte swap is enabled for word transfers
+ */
+bool dma_crc32_word_bswap(void);
@@ -15,19 +15,118 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/**
+ * @brief Where the time spent on flash went since flash_init
+ */
+typedef struct flash_stats {
+    uint32_t erase_us;        // Time spent erasing, sectors and blocks
+    uint32_t program_us;      // Time spent programming pages
+    uint32_t sectors_erased;  // 4K sector erases
+    uint32_t blocks_erased;   // 32K and 64K block erases
+    uint32_t pages_programmed;
+    uint32_t sectors_skipped; // Sectors that already held their data
+    uint32_t pages_retried;   // Page programs that did not read back as written
+    uint32_t failed_address;  // Flash address of the first page that would not program at all, 0 if none
+} flash_stats_t;
+
 void flash_init();
 void flash_deinit();
+/**
+ * @brief Buffer data for the current address, handing each full sector over to be written
+ *
+ * @details A gap between the end of the last intake and `address` is left erased rather than written
+ *
+ * @param address Lower 16 bits of the address of the data, the upper bits follow from flash_new_address
+ * @param src Data
+ * @param sz Length of the data, may cross any number of page and sector boundaries
+ */
 void flash_intake(uint16_t address, unsigned char *src, size_t sz);
-void flash_finalize();
+
+/**
+ * @brief Write out everything that is left and commit the program
+ *
+ * @details The flash header is held back from the moment it is received, the header in flash is erased instead.
+ * Every sector of the program is checked against the new header's sector table, using CRC32s taken as sectors
+ * were handed over to be written, and only then is the header programmed. A partially written program never
+ * has a valid header. If no header was received the program is checked against the one already in flash.
+ *
+ * @retval true Program checked out and its header is in place
+ * @retval false Program does not match its header or a page would not program, it will not boot
+ */
+bool flash_finalize();
+
+/**
+ * @brief Make progress on pending flash writes
+ *
+ * @details Compares the pending sector against flash, erases it or programs one of its pages.
+ * Sectors that already hold the same data are not erased or programmed. Every page is read back past the XIP cache
+ * and checked against the CRC32 of its data. A page that does not match is programmed again, then its sector is
+ * erased and written again. A page that still does not match is left in flash_stats_t::failed_address, which
+ * fails flash_finalize. Input schemes should call this while waiting on input
+ * so erasing/programming overlaps with receiving. Runs from RAM with interrupts disabled during the flash operation.
+ *
+ * @retval true There is still more to write
+ * @retval false Nothing left to write
+ */
+bool flash_service(void);
 /**
  * @brief Set a new address to begin programming from
  *
- * @details This address defines what sector should be erased and where a page should start writing
+ * @details This address defines what sector should be erased and where a page should start writing. Moving forward
+ * leaves the bytes in between erased within the current sector and skips whole sectors without touching them.
  *
  * @warning Must be called at least once before ingesting data
- * @warning `address` MUST be aligned to a 4096 byte address, or whatever the size of a flash sector is
+ * @warning Moving back to an `address` that is not sector aligned loses whatever its sector held before `address`
  *
  * @param address Flash address to begin programming from
  */
 void flash_new_address(uint32_t address);
+
+/**
+ * @brief Whether a range lies within the flash header and program region, the only flash an input may write
+ *
+ * @details Checked without adding `length` to `address`, so a range near the top of the address space cannot wrap
+ * around to pass.
+ *
+ * @param address Start of the range
+ * @param length Length of the range
+ * @retval true Range is within [FLASH_HEADER_ORIGIN, FLASH_MAIN_ORIGIN + FLASH_MAIN_LENGTH)
+ * @retval false Range starts or ends outside of it
+ */
+bool flash_in_range(uint32_t address, uint32_t length);
+
+/**
+ * @brief Erase the sectors covering a range of the program ahead of writing it
+ *
+ * @details Uses 64K and 32K block erases where the range is aligned to them and sector erases at its edges.
+ * Sectors within the range are programmed straight away when they are handed over, without being compared
+ * or erased again. Pending writes are finished first.
+ *
+ * @warning Anything already written to the range in this session is lost, call this before sending its data
+ *
+ * @param address Start of the range, rounded down to a sector
+ * @param length Length of the range, its end is rounded up to a sector
+ * @retval true Range was erased
+ * @retval false Range is not within the program region
+ */
+bool flash_erase_range(uint32_t address, uint32_t length);
+
+/**
+ * @brief How far an interrupted transfer of a program got
+ *
+ * @details From the moment the flash header is received until it is committed, the header sector journals which
+ * sectors of the program have been programmed and read back. A transfer of the same program that starts again
+ * after a reset carries on with the journal, and with the sectors it has already written. The host resends the
+ * header, then only what follows the resume point.
+ *
+ * @param crc CRC32 of the program, from its flash header
+ * @param size Size of the program, from its flash header
+ * @return uint32_t Sectors from the start of the program that need not be sent again, 0 for a different program
+ */
+uint32_t flash_resume_point(uint32_t crc, uint32_t size);
+
+/**
+ * @brief Erase and program timing since flash_init
+ */
+const flash_stats_t *flash_get_stats(void);
 // void flash_start();
@@ -0,0 +1,97 @@
+/**
+ * @file frame.h
+ * @author IR
+ * @brief Header file for the framed binary input scheme
+ * @details Frames carry up to FRAME_PAYLOAD_MAX bytes of image data with a sequence number and a CRC32.
+ * The host keeps up to FRAME_WINDOW frames in flight; the device cumulatively ACKs frames as they are
+ * written and NAKs the first missing sequence number so only that frame has to be resent.
+ * ZDATA frames carry LZ compressed data (see lz.h), decompressed straight into the flash buffers.
+ * ERASE frames let the host erase the ranges it is about to send with block erases before any data arrives.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// "PMFR" little-endian, marks the start of every host to device frame
+#define FRAME_MAGIC 0x52464D50u
+
+// Marks the start of every device to host reply
+#define FRAME_REPLY_SYNC 0x5A
+
+// Largest payload a single frame may carry, one flash sector
+#define FRAME_PAYLOAD_MAX 4096
+
+// Largest amount of data a single ZDATA frame may decompress to
+#define FRAME_INFLATED_MAX 32768
+
+// Number of frames the host may have outstanding
+#define FRAME_WINDOW 4
+
+// Abandon a partially received frame after this long without a byte
+#define FRAME_BYTE_TIMEOUT_US 100000
+
+typedef enum FrameType {
+    FRAME_Hello = 0x01,  // Start a new session, resets sequence numbers
+    FRAME_Data = 0x02,   // Payload is image data to be written at `address`
+    FRAME_End = 0x03,    // All data sent, finalize flash
+    FRAME_Query = 0x04,  // ACK carries the CRC32 of the program in flash, NAK if it does not verify
+    FRAME_ZData = 0x05,  // Payload is a compressed block that decompresses to `extent` bytes written at `address`
+    FRAME_Sector = 0x06, // ACK carries the CRC32 of the `extent` bytes of flash at `address`, NAK if out of range
+    FRAME_Erase = 0x07,  // Erase `extent` sectors from `address` ahead of the data that will be written there
+    FRAME_Resume = 0x08, // Payload is the CRC32 and size of a program, ACK carries the sectors of it an interrupted transfer wrote
+} FrameType;
+
+typedef enum FrameReplyCode {
+    FRAME_ACK = 0x06,  // Every frame up to and including `seq` has been handled
+    FRAME_NAK = 0x15,  // Frame `seq` is missing or was corrupt, resend it
+    FRAME_FAIL = 0x18, // Frame `seq` could not be handled, the session is over. Carries the address of a page that would not program, if any
+} FrameReplyCode;
+
+/**
+ * @brief Header preceding every frame payload
+ *
+ * @note The CRC32 trailing the payload covers this header and the payload
+ */
+typedef struct __attribute__((packed)) frame_header {
+    uint32_t magic;
+    uint16_t seq;
+    uint8_t type;
+    uint8_t flags;
+    uint32_t address;
+    uint16_t length;
+    uint16_t extent; // ZDATA: decompressed length of the payload, SECTOR: bytes to checksum, ERASE: sectors, 0 otherwise
+} frame_header_t;
+
+/**
+ * @brief Reply sent from the device for every handled, duplicated or rejected frame
+ */
+typedef struct __attribute__((packed)) frame_reply {
+    uint8_t sync;
+    uint8_t code;
+    uint16_t seq;
+    uint32_t value;
+} frame_reply_t;
+
+/**
+ * @brief Initialize peripherals for this input scheme
+ */
+void frame_init(void);
+
+/**
+ * @brief Deinitialize peripherals for this input scheme
+ */
+void frame_deinit(void);
+
+/**
+ * @brief Receive frames and write them to flash until the host ends the session
+ *
+ * @retval true Image was received and finalized
+ * @retval false Session failed
+ */
+bool frame_load(void);
@@ -22,6 +22,12 @@ typedef enum HexType {
     HEX_ExtendedStartAddress = 0x05
 } HexType;
 
+typedef enum HexStatus {
+    HEX_Pending, // Every character was consumed, the record is not complete yet
+    HEX_Record,  // A record was completed and its checksum passed, it is held in HEX
+    HEX_Invalid  // The record had a bad character or checksum and was dropped
+} HexStatus;
+
 /**
  * @brief Global HEX structure used to intake lines of hex
  */
@@ -29,10 +35,29 @@ extern struct HEX_t {
     uint8_t count;
     uint16_t address;
     HexType type;
-    uint8_t data[16];
+    uint8_t data[255];
     uint8_t checksum;
 } HEX;
 
+/**
+ * @brief Forget any partially parsed record, the parser waits for the next ':'
+ */
+void hex_parse_reset(void);
+
+/**
+ * @brief Feed characters to the record parser
+ *
+ * @details Decodes, validates and checksums in a single pass, data bytes are decoded straight into HEX.
+ * Stops at the end of a record so that it can be handled before anything else is parsed.
+ * Characters outside of a record (line endings, noise) are skipped. Has no hardware dependencies.
+ *
+ * @param src Characters to parse
+ * @param len Number of characters
+ * @param used Set to the number of characters consumed
+ * @return HexStatus Whether a record is ready in HEX
+ */
+HexStatus hex_parse(const char *src, uint32_t len, uint32_t *used);
+
 /**
  * @brief Initialize peripherals for this input scheme
  */
@@ -1,7 +1,9 @@
 /**
  * @file led.h
  * @author IR
- * @brief Header file for led utility functions
+ * @brief Header file for the bootloader's LED status engine
+ * @details Both LEDs are driven by PWM and a repeating timer steps through the current pattern, so signalling
+ * never waits on anything. LED_PIN shows progress, LED2_PIN shows the outcome.
  * @version 0.1
  * @date 2024-04-06
  *
@@ -14,22 +16,43 @@
 #include <pico/stdlib.h>
 #include <stdint.h>
 
+// Period of the timer stepping through patterns
+#define LED_TICK_MS 20
+
+typedef enum LedPattern {
+    LED_Off = 0,       // Both LEDs off
+    LED_Idle = 1,      // LED_PIN breathes, waiting for a host
+    LED_Receiving = 2, // LED_PIN glows dimly and flickers while data arrives
+    LED_Erasing = 3,   // LED_PIN fully on
+    LED_Error = 4,     // LED2_PIN blinks, loading failed or no valid program
+    LED_Done = 5,      // LED2_PIN fully on, the program was loaded
+} LedPattern;
+
 /**
- * @brief Blink a gpio pin
+ * @brief Switch to a pattern, takes effect on the next tick
  *
- * @param gpio gpio to blink
- * @param count number of times to blink
- * @param ms length to hold blinks for in ms
+ * @param pattern Pattern to show
  */
-void blink(uint gpio, uint32_t count, uint32_t ms);
+void led_set(LedPattern pattern);
 
 /**
- * @brief Toggle a gpio pin
+ * @brief Note that data arrived, shown as flicker while receiving
  *
- * @param gpio gpio to toggle
+ * @details Cheap enough to call for every record. Switches from LED_Idle or LED_Error to LED_Receiving.
+ */
+void led_activity(void);
+
+/**
+ * @brief Flash LED2_PIN briefly for a rejected record or frame, the pattern carries on
  */
-void toggle(uint gpio);
+void led_fault(void);
 
+/**
+ * @brief Take over both LEDs and start the pattern timer on LED_Idle
+ */
 void led_init();
 
-void led_deinit();
\ No newline at end of file
+/**
+ * @brief Stop the pattern timer and hand both LEDs back as plain GPIOs
+ */
+void led_deinit();
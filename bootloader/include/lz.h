@@ -0,0 +1,65 @@
+/**
+ * @file lz.h
+ * @author IR
+ * @brief Header file for the streaming LZ decoder used for compressed images
+ * @details The format is LZ4-like. Each block is a run of sequences:
+ *
+ *     token u8 | [literal length ext] | literals | offset u16 | [match length ext]
+ *
+ * The high nibble of the token is the literal count and the low nibble the match length minus LZ_MIN_MATCH,
+ * a nibble of 15 is followed by bytes that are added to it until one is not 255. The last sequence of a
+ * block may stop after its literals. Offsets reach back up to LZ_WINDOW bytes into everything decoded since
+ * lz_init, so history carries over from one block to the next.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Furthest back a match may reach, must be a power of two
+#define LZ_WINDOW 4096
+
+// Shortest match that gets encoded
+#define LZ_MIN_MATCH 4
+
+// Decoded data is handed to the sink at most this many bytes at a time
+#define LZ_FLUSH 256
+
+/**
+ * @brief Receives decoded data, in order
+ */
+typedef void (*lz_sink_t)(const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Decoder state, holds the history matches are copied from
+ */
+typedef struct lz_stream {
+    lz_sink_t sink;
+    uint32_t pos;     // Bytes decoded since lz_init
+    uint32_t flushed; // Bytes handed to the sink
+    uint8_t window[LZ_WINDOW];
+} lz_stream_t;
+
+/**
+ * @brief Start a new stream, forgetting all history
+ *
+ * @param lz Decoder state
+ * @param sink Where decoded data is sent
+ */
+void lz_init(lz_stream_t *lz, lz_sink_t sink);
+
+/**
+ * @brief Decode a complete block, everything it decodes to has been passed to the sink on return
+ *
+ * @param lz Decoder state
+ * @param src Compressed block
+ * @param len Length of the compressed block
+ * @param limit Most bytes the block may decode to
+ * @return int32_t Number of bytes decoded, -1 if the block is malformed or decodes to more than `limit`
+ */
+int32_t lz_decode(lz_stream_t *lz, const uint8_t *src, uint32_t len, uint32_t limit);
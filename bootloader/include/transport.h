@@ -0,0 +1,100 @@
+/**
+ * @file transport.h
+ * @author IR
+ * @brief Header file for the link the bootloader receives programs over
+ * @details Input schemes only see a byte stream. The backend is selected at build time through the
+ * BOOTLOADER_TRANSPORT CMake cache variable:
+ *
+ * BOOT_TRANSPORT_USB: USB CDC through pico_stdio_usb
+ * BOOT_TRANSPORT_UART: BOOT_UART received by DMA into a ring buffer, which keeps filling while flash operations
+ * have the CPU and interrupts tied up
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <pico/stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Bring up the link, called from the input scheme's init
+ */
+void transport_init(void);
+
+/**
+ * @brief Flush and release the link, called from the input scheme's deinit
+ */
+void transport_deinit(void);
+
+/**
+ * @brief Wait for a character
+ *
+ * @param timeout_us How long to wait, 0 only checks for a character that has already arrived
+ * @return int Received character or PICO_ERROR_TIMEOUT
+ */
+int transport_getchar_timeout_us(uint32_t timeout_us);
+
+/**
+ * @brief Wait for a character for as long as it takes
+ *
+ * @return int Received character
+ */
+int transport_getchar(void);
+
+/**
+ * @brief Take whatever has already arrived, without waiting
+ *
+ * @param dst Buffer to copy into
+ * @param len Most characters to take
+ * @return uint32_t Characters copied into dst
+ */
+uint32_t transport_read(uint8_t *dst, uint32_t len);
+
+/**
+ * @brief Wait for a character, using the time to work through pending flash writes
+ *
+ * @param timeout_us How long to wait once nothing is left to write, 0 waits forever
+ * @return int Received character or PICO_ERROR_TIMEOUT
+ */
+int transport_getchar_serviced(uint32_t timeout_us);
+
+/**
+ * @brief Receive exactly len characters, working through pending flash writes while waiting for them
+ *
+ * @param dst Buffer to copy into
+ * @param len Characters to receive
+ * @param timeout_us How long to wait for each character once nothing is left to write, 0 waits forever
+ * @return bool Whether all len characters arrived, false if one took longer than timeout_us
+ */
+bool transport_read_serviced(uint8_t *dst, uint32_t len, uint32_t timeout_us);
+
+/**
+ * @brief Send a single character as is
+ *
+ * @param c Character to send
+ */
+void transport_putchar(uint8_t c);
+
+/**
+ * @brief Send a buffer as is
+ *
+ * @param src Data to send
+ * @param len Length of src in bytes
+ */
+void transport_write(const void *src, uint32_t len);
+
+/**
+ * @brief Send a string, without a terminating newline
+ *
+ * @param s String to send
+ */
+void transport_puts(const char *s);
+
+/**
+ * @brief Wait until everything sent so far has gone out
+ */
+void transport_flush(void);
@@ -0,0 +1,123 @@
+"""LZ encoder for the bootloader's compressed frames, see include/lz.h for the format
+
+Blocks are encoded from one continuous stream so that matches may reach back into earlier blocks,
+the same as the decoder which keeps its history for the whole session.
+"""
+from typing import Tuple
+
+LZ_WINDOW = 4096
+LZ_MIN_MATCH = 4
+LZ_MAX_CHAIN = 32
+
+
+def _length_cost(n: int) -> int:
+    """Extension bytes needed for a literal or match length nibble"""
+    return 0 if n < 15 else (n - 15) // 255 + 1
+
+
+def _length_bytes(n: int) -> bytes:
+    out = bytearray()
+    n -= 15
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+    return bytes(out)
+
+
+def _sequence(literals: bytes, offset: int = 0, match: int = 0) -> bytes:
+    """Encode one sequence, a sequence without a match may only end a block"""
+    lit = len(literals)
+    mlen = match - LZ_MIN_MATCH if match else 0
+    out = bytearray([(min(lit, 15) << 4) | min(mlen, 15)])
+    if lit >= 15:
+        out += _length_bytes(lit)
+    out += literals
+    if match:
+        out += offset.to_bytes(2, 'little')
+        if mlen >= 15:
+            out += _length_bytes(mlen)
+    return bytes(out)
+
+
+class Encoder:
+    """Greedy hash chain encoder over a whole stream, handing it out a block at a time"""
+
+    def __init__(self, data: bytes):
+        self.data = data
+        self.head = {}
+        self.prev = [-1] * len(data)
+        self.pos = 0
+
+    def _insert(self, p: int) -> None:
+        key = self.data[p:p + LZ_MIN_MATCH]
+        if len(key) == LZ_MIN_MATCH:
+            self.prev[p] = self.head.get(key, -1)
+            self.head[key] = p
+
+    def _extend(self, c: int, p: int, limit: int) -> int:
+        data = self.data
+        n = 0
+        while n < limit:
+            step = min(64, limit - n)
+            if data[c + n:c + n + step] == data[p + n:p + n + step]:
+                n += step
+                continue
+            while n < limit and data[c + n] == data[p + n]:
+                n += 1
+            break
+        return n
+
+    def _match(self, p: int, end: int) -> Tuple[int, int]:
+        """Longest match for position p not reaching past end, as (length, offset)"""
+        best, best_off = 0, 0
+        limit = end - p
+        if limit < LZ_MIN_MATCH:
+            return 0, 0
+        c = self.head.get(self.data[p:p + LZ_MIN_MATCH], -1)
+        chain = LZ_MAX_CHAIN
+        while c >= 0 and p - c <= LZ_WINDOW and chain:
+            n = self._extend(c, p, limit)
+            if n > best:
+                best, best_off = n, p - c
+                if n == limit:
+                    break
+            c = self.prev[c]
+            chain -= 1
+        return (best, best_off) if best >= LZ_MIN_MATCH else (0, 0)
+
+    def block(self, end: int, out_max: int) -> Tuple[bytes, int]:
+        """Encode from the current position up to `end` or until the block would exceed `out_max` bytes
+
+        Returns:
+            Tuple[bytes, int]: The compressed block and how many bytes of the stream it decodes to
+        """
+        data = self.data
+        start = p = lit = self.pos
+        out = bytearray()
+
+        while p < end:
+            match, offset = self._match(p, end)
+            if match:
+                seq = _sequence(data[lit:p], offset, match)
+                if len(out) + len(seq) > out_max:
+                    break
+                out += seq
+                for i in range(p, p + match):
+                    self._insert(i)
+                p += match
+                lit = p
+            else:
+                # Keep room to end the block on these literals
+                n = p + 1 - lit
+                if len(out) + 1 + _length_cost(n) + n > out_max:
+                    break
+                self._insert(p)
+                p += 1
+
+        if p > lit:
+            out += _sequence(data[lit:p])
+
+        self.pos = p
+        return bytes(out), p - start
+
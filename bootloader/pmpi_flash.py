@@ -0,0 +1,380 @@
+"""Flash PMPi boards over USB STDIO, as many as are attached at once
+
+Replaces hex_usb.py. Every device is flashed on its own thread through these phases:
+
+    reboot     DEBUG is sent to the running app, which resets into the bootloader
+    handshake  the port is polled until the bootloader answers a probe, no fixed sleeps
+    resume     FRAME and BIN, sectors a transfer that was cut short already wrote are not sent again
+    compare    FRAME only, the device's sector CRCs are checked so only what changed is sent
+    erase      FRAME only, everything about to be written is erased up front
+    transfer   lines, records or frames are streamed with a window of them in flight
+    finalize   the device commits the flash header and answers
+
+and the time and throughput of each is reported. The scheme has to match the bootloader's BOOTLOADER_INPUT,
+by default it follows the image: FRAME for a .hex and BIN for a _OUT.bin.
+
+    python pmpi_flash.py build/PMPi_OUT.hex --all
+    python pmpi_flash.py build/PMPi_OUT.hex --scheme hex --port /dev/ttyACM0 --port /dev/ttyACM1
+    python pmpi_flash.py build/PMPi_OUT.bin --port COM16 --baud 1000000
+"""
+import argparse
+import binascii
+import sys
+import threading
+import time
+from typing import Any, Callable, List, Optional, Tuple
+
+import serial
+
+import bin_usb
+import frame_usb
+
+PICO_VID = 0x2E8A
+
+HEX_PROMPT = 0x00
+HEX_ACK = 0x01
+
+# A line the HEX scheme rejects for its checksum, the device prompts again for it
+HEX_PROBE = b':020000041000EB\n'
+
+# The bootloaders say this once they are done, whether the program was committed or not
+BRANCHING = b'Branching'
+
+# How often a port that is not there yet is tried again
+POLL_INTERVAL = 0.1
+
+# How long a device has to answer a probe, and how long it has to be quiet after
+PROBE_TIMEOUT = 0.25
+PROBE_QUIET = 0.05
+
+# Read timeout while waiting on frame replies, the same as frame_usb.py
+FRAME_READ_TIMEOUT = 0.05
+
+print_lock = threading.Lock()
+
+
+def log(name: str, text: str) -> None:
+    with print_lock:
+        print(f"{name}: {text}", flush=True)
+
+
+def rate(size: int, seconds: float) -> str:
+    return f"{size / seconds / 1024:.1f} KiB/s" if seconds > 0 else "-"
+
+
+class Device:
+    """A board being flashed, found again by its USB serial number if its port moves when it resets"""
+
+    def __init__(self, port: str, serial_number: Optional[str], args: argparse.Namespace):
+        self.port = port
+        self.serial_number = serial_number
+        self.args = args
+        self.phases: List[Tuple[str, float, int]] = []  # (phase, seconds, bytes)
+        self.error: Optional[str] = None
+
+    def phase(self, name: str, start: float, size: int = 0) -> None:
+        """Record a phase that began at start and log it"""
+        seconds = time.monotonic() - start
+        self.phases.append((name, seconds, size))
+        log(self.port, f"{name:<9} {seconds:6.2f}s" + (f"  {size} bytes, {rate(size, seconds)}" if size else ""))
+
+    def locate(self) -> str:
+        """The device's port, which may have been renumbered when it reset"""
+        if self.serial_number:
+            for info in list_devices():
+                if info.serial_number == self.serial_number:
+                    return info.device
+        return self.port
+
+    def open(self, timeout: float) -> serial.Serial:
+        return serial.Serial(
+            port=self.locate(),
+            baudrate=self.args.baud,
+            parity=serial.PARITY_NONE,
+            stopbits=serial.STOPBITS_ONE,
+            bytesize=serial.EIGHTBITS,
+            timeout=timeout
+        )
+
+    def reboot(self) -> None:
+        """Ask the app to reset into the bootloader, a bootloader that is already running ignores it"""
+        start = time.monotonic()
+        try:
+            ser = self.open(PROBE_TIMEOUT)
+            ser.write(b'DEBUG')
+            ser.close()
+        except serial.serialutil.SerialException:
+            pass
+        self.phase("reboot", start)
+
+    def handshake(self, probe: Callable[[serial.Serial], Any], timeout: float) -> Tuple[serial.Serial, Any]:
+        """Poll until the bootloader answers probe, returns its open port and what probe made of the answer"""
+        start = time.monotonic()
+        deadline = start + self.args.timeout
+        while time.monotonic() < deadline:
+            try:
+                ser = self.open(timeout)
+            except serial.serialutil.SerialException:
+                # Not back from resetting yet
+                time.sleep(POLL_INTERVAL)
+                continue
+
+            try:
+                answer = probe(ser)
+                if answer:
+                    ser.timeout = timeout
+                    self.phase("handshake", start)
+                    return ser, answer
+            except serial.serialutil.SerialException:
+                # Went away part way through, the app only just got round to resetting
+                pass
+            ser.close()
+            time.sleep(POLL_INTERVAL)
+
+        raise serial.serialutil.SerialException(f"No answer from the bootloader in {self.args.timeout:.0f}s")
+
+    def flash(self, image: bytes) -> None:
+        """Flash the image with the selected scheme, self.error holds why if it failed"""
+        start = time.monotonic()
+        try:
+            self.reboot()
+            if self.args.scheme == 'hex':
+                flash_hex(self, image)
+            elif self.args.scheme == 'bin':
+                flash_bin(self, image)
+            else:
+                flash_frame(self, image)
+        except serial.serialutil.SerialException as e:
+            self.error = str(e)
+            log(self.port, f"FAILED {e}")
+            return
+        log(self.port, f"done      {time.monotonic() - start:6.2f}s")
+
+
+def prompt_probe(probe: bytes, prompt: int) -> Callable[[serial.Serial], bool]:
+    """A probe for schemes where the device prompts for what it wants next
+
+    Something the device rejects is sent, and it answers with a fresh prompt. Anything it had already sent is
+    skipped, and so is whatever arrives until it goes quiet, so the prompt for the first line or record has been
+    taken once this returns.
+    """
+
+    def run(ser: serial.Serial) -> bool:
+        ser.reset_input_buffer()
+        ser.write(probe)
+        deadline = time.monotonic() + PROBE_TIMEOUT
+        while time.monotonic() < deadline:
+            reply = ser.read(1)
+            if reply and reply[0] == prompt:
+                ser.timeout = PROBE_QUIET
+                while ser.read(1):
+                    pass
+                return True
+        return False
+
+    return run
+
+
+def stream(ser: serial.Serial, items: List[bytes], window: int, timeout: float, prompt: int, ack: int,
+           fail: Optional[int] = None, prompted: bool = True) -> None:
+    """Send items keeping up to window bytes of them in flight, the device ACKs them in order
+
+    The device prompts before and ACKs after every item. A second prompt without an ACK in between means the
+    oldest item in flight was corrupt. Everything behind it has already been sent, so it cannot simply be sent
+    again, the transfer fails instead. Neither USB nor the UART ring buffer lose data in practice.
+    prompted says whether the prompt for the first item has already been taken.
+    """
+    base = 0
+    nxt = 0
+    in_flight = 0
+    heard = time.monotonic()
+
+    while base < len(items):
+        while nxt < len(items) and (nxt == base or in_flight + len(items[nxt]) <= window):
+            ser.write(items[nxt])
+            in_flight += len(items[nxt])
+            nxt += 1
+
+        # Everything that has arrived is taken at once, but never what comes after the last item in flight
+        expected = 2 * (nxt - base) - prompted
+        replies = ser.read(max(1, min(ser.in_waiting, expected)))
+        if not replies:
+            if time.monotonic() - heard > timeout:
+                raise serial.serialutil.SerialException(f"Device stopped responding at {base} of {len(items)}")
+            continue
+        heard = time.monotonic()
+
+        for reply in replies:
+            if reply == ack:
+                in_flight -= len(items[base])
+                base += 1
+                prompted = False
+            elif reply == prompt:
+                if prompted:
+                    raise serial.serialutil.SerialException(f"Device rejected {base} of {len(items)}")
+                prompted = True
+            elif reply == fail:
+                raise serial.serialutil.SerialException(f"Device refused {base} of {len(items)}")
+
+
+def flash_hex(device: Device, image: bytes) -> None:
+    lines = [line.strip() + b'\n' for line in image.splitlines() if line.strip().startswith(b':')]
+    ser, _ = device.handshake(prompt_probe(HEX_PROBE, HEX_PROMPT), device.args.reply_timeout)
+
+    # The end of file line is ACKed as soon as it is read, the program is committed after it
+    start = time.monotonic()
+    stream(ser, lines, device.args.window, device.args.reply_timeout, HEX_PROMPT, HEX_ACK)
+    device.phase("transfer", start, sum(len(line) for line in lines))
+
+    # HEX has no answer for a failed commit, the bootloader says it is branching either way
+    start = time.monotonic()
+    said = b''
+    deadline = start + device.args.timeout
+    while BRANCHING not in said:
+        if time.monotonic() > deadline:
+            raise serial.serialutil.SerialException("Device did not finish")
+        try:
+            said = (said + ser.read(len(BRANCHING)))[-2 * len(BRANCHING):]
+        except serial.serialutil.SerialException:
+            # Already reset into the program, the port went with whatever it had not been read yet
+            break
+    device.phase("finalize", start)
+    ser.close()
+
+
+def flash_bin(device: Device, image: bytes) -> None:
+    body = bin_usb.BODY.pack(0, 0)
+    probe = bin_usb.HEADER.pack(bin_usb.BIN_MAGIC, binascii.crc32(body) ^ 1) + body
+    ser, _ = device.handshake(prompt_probe(probe, bin_usb.BIN_READY), device.args.reply_timeout)
+
+    # The query takes the prompt the probe left, the device prompts again for the first record
+    done = 0
+    program = bin_usb.program_id(image)
+    prompted = True
+    if program is not None:
+        start = time.monotonic()
+        done = bin_usb.resume(ser, *program)
+        prompted = False
+        device.phase("resume", start)
+        if done:
+            log(device.port, f"resuming after {done} sectors")
+    recs = bin_usb.records(image, resume=done)
+
+    start = time.monotonic()
+    stream(ser, recs[:-1], device.args.window, device.args.reply_timeout, bin_usb.BIN_READY, bin_usb.BIN_ACK, bin_usb.BIN_FAIL, prompted)
+    device.phase("transfer", start, sum(len(rec) for rec in recs[:-1]))
+
+    # The record that ends the image is answered once the program is committed, its prompt is still to come
+    start = time.monotonic()
+    stream(ser, recs[-1:], device.args.window, device.args.timeout, bin_usb.BIN_READY, bin_usb.BIN_ACK, bin_usb.BIN_FAIL, False)
+    device.phase("finalize", start)
+    ser.close()
+
+
+def flash_frame(device: Device, image: bytes) -> None:
+    def probe(ser: serial.Serial) -> Optional[frame_usb.FrameLink]:
+        # The session carries on from the sequence number the HELLO left
+        ser.reset_input_buffer()
+        link = frame_usb.FrameLink(ser, PROBE_TIMEOUT)
+        try:
+            link.hello(attempts=1)
+        except serial.serialutil.SerialException:
+            return None
+        return link
+
+    ser, link = device.handshake(probe, FRAME_READ_TIMEOUT)
+    link.timeout = device.args.reply_timeout
+    link.progress = False
+
+    start = time.monotonic()
+    segments = frame_usb.fill_gaps(frame_usb.clip_segments(frame_usb.parse_hex(image.decode('utf-8').splitlines())))
+    program = frame_usb.program_id(segments)
+    if program is not None and link.query() == program[0]:
+        device.phase("compare", start)
+        log(device.port, f"image unchanged (CRC32 {program[0]:08x})")
+        start = time.monotonic()
+        link.send([(frame_usb.FRAME_END, 0, b'')])
+        device.phase("finalize", start)
+        ser.close()
+        return
+
+    # Sectors a transfer that was cut short already wrote are not even compared
+    sectors = frame_usb.split_segments(segments, frame_usb.SECTOR_SIZE)
+    if program is not None:
+        done = link.resume(*program)
+        device.phase("resume", start)
+        if done:
+            log(device.port, f"resuming after {done} sectors")
+            sectors = frame_usb.drop_resumed(sectors, done)
+
+    # Only the sectors that differ from what is already in flash are sent
+    start = time.monotonic()
+    flashed = link.sector_crcs(sectors)
+    stale = [(address, data) for (address, data), crc in zip(sectors, flashed) if crc != binascii.crc32(data)]
+    device.phase("compare", start, sum(len(data) for _, data in sectors))
+    log(device.port, f"{len(stale)} of {len(sectors)} sectors differ")
+
+    start = time.monotonic()
+    link.send([(frame_usb.FRAME_ERASE, address, b'', count) for address, count in frame_usb.erase_runs(stale)])
+    device.phase("erase", start, len(stale) * frame_usb.SECTOR_SIZE)
+
+    frames = frame_usb.compress_segments(frame_usb.merge_segments(stale), link.payload_max)
+    start = time.monotonic()
+    link.send(frames)
+    device.phase("transfer", start, sum(len(data) for _, data in stale))
+    log(device.port, f"sent as {sum(len(frame[2]) for frame in frames)} bytes compressed")
+
+    start = time.monotonic()
+    link.send([(frame_usb.FRAME_END, 0, b'')])
+    device.phase("finalize", start)
+    ser.close()
+
+
+def list_devices() -> list:
+    """Serial ports of attached Raspberry Pi USB devices"""
+    from serial.tools import list_ports
+    return [info for info in list_ports.comports() if info.vid == PICO_VID]
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('image', help="Image to flash, build/PMPi_OUT.hex or build/PMPi_OUT.bin")
+    parser.add_argument('--port', action='append', default=[], help="Port of a device to flash, may be given more than once")
+    parser.add_argument('--all', action='store_true', help="Flash every attached Raspberry Pi USB device")
+    parser.add_argument('--scheme', choices=['hex', 'frame', 'bin'], help="Bootloader input scheme, by default from the image's extension")
+    parser.add_argument('--baud', type=int, default=3000000, help="Baud rate for a bootloader built with the UART transport, BOOT_UART_BAUD, USB ignores it")
+    parser.add_argument('--window', type=int, default=16384, help="HEX and BIN bytes in flight, FRAME uses the device's window")
+    parser.add_argument('--timeout', type=float, default=10.0, help="Seconds a device has to reset into the bootloader or commit the program")
+    parser.add_argument('--reply-timeout', type=float, default=0.5, help="Seconds a device has to answer while streaming")
+    args = parser.parse_args()
+
+    if args.scheme is None:
+        args.scheme = 'bin' if args.image.lower().endswith('.bin') else 'frame'
+
+    with open(args.image, 'rb') as file:
+        image = file.read()
+
+    devices = [Device(port, None, args) for port in args.port]
+    if args.all:
+        known = set(args.port)
+        devices += [Device(info.device, info.serial_number, args) for info in list_devices() if info.device not in known]
+    if not devices:
+        parser.error("no devices, give --port or --all")
+
+    start = time.monotonic()
+    threads = [threading.Thread(target=device.flash, args=(image,)) for device in devices]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.monotonic() - start
+
+    failed = [device for device in devices if device.error]
+    print(f"{len(devices) - len(failed)} of {len(devices)} devices flashed in {elapsed:.2f}s")
+    for device in failed:
+        print(f"  {device.port}: {device.error}")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
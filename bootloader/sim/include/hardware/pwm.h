@@ -0,0 +1,25 @@
+/**
+ * @file pwm.h
+ * @author IR
+ * @brief Host mock of hardware/pwm.h, levels are kept per GPIO and nothing else
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <pico/stdlib.h>
+
+typedef struct {
+    uint32_t top;
+} pwm_config;
+
+static inline pwm_config pwm_get_default_config(void) { return (pwm_config){.top = 0xFFFF}; }
+static inline void pwm_config_set_wrap(pwm_config *c, uint16_t wrap) { c->top = wrap; }
+static inline uint pwm_gpio_to_slice_num(uint gpio) { return (gpio >> 1) & 7; }
+
+void pwm_init(uint slice_num, pwm_config *c, bool start);
+void pwm_set_enabled(uint slice_num, bool enabled);
+void pwm_set_gpio_level(uint gpio, uint16_t level);
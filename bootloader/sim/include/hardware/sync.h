@@ -0,0 +1,16 @@
+/**
+ * @file sync.h
+ * @author IR
+ * @brief Host mock of hardware/sync.h, there are no interrupts to disable
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <pico/stdlib.h>
+
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) { (void)status; }
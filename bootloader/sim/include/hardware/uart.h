@@ -0,0 +1,34 @@
+/**
+ * @file uart.h
+ * @author IR
+ * @brief Host mock of hardware/uart.h, the UART is the simulated host stream
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <pico/stdlib.h>
+
+typedef struct uart_inst uart_inst_t;
+
+typedef struct {
+    io_rw_32 dr;
+} uart_hw_t;
+
+#define uart0 ((uart_inst_t *)0)
+#define uart1 ((uart_inst_t *)1)
+
+#define DREQ_UART0_TX 20
+#define DREQ_UART0_RX 21
+#define DREQ_UART1_TX 22
+#define DREQ_UART1_RX 23
+
+uint uart_init(uart_inst_t *uart, uint baudrate);
+void uart_deinit(uart_inst_t *uart);
+uart_hw_t *uart_get_hw(uart_inst_t *uart);
+uint uart_get_dreq(uart_inst_t *uart, bool tx);
+void uart_putc_raw(uart_inst_t *uart, char c);
+void uart_tx_wait_blocking(uart_inst_t *uart);
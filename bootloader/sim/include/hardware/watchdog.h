@@ -0,0 +1,27 @@
+/**
+ * @file watchdog.h
+ * @author IR
+ * @brief Host mock of hardware/watchdog.h
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <pico/stdlib.h>
+
+typedef struct {
+    io_rw_32 ctrl;
+    io_wo_32 load;
+    io_ro_32 reason;
+    io_rw_32 scratch[8];
+    io_rw_32 tick;
+} watchdog_hw_t;
+
+extern watchdog_hw_t *watchdog_hw;
+
+void watchdog_reboot(uint32_t pc, uint32_t sp, uint32_t delay_ms);
+bool watchdog_caused_reboot(void);
+bool watchdog_enable_caused_reboot(void);
@@ -0,0 +1,21 @@
+/**
+ * @file stdio_usb.h
+ * @author IR
+ * @brief Host mock of pico/stdio_usb.h, the driver is the simulated USB CDC stream
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <pico/stdlib.h>
+
+typedef struct stdio_driver {
+    void (*out_chars)(const char *buf, int len);
+    void (*out_flush)(void);
+    int (*in_chars)(char *buf, int len);
+} stdio_driver_t;
+
+extern stdio_driver_t stdio_usb;
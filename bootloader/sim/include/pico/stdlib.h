@@ -0,0 +1,81 @@
+/**
+ * @file stdlib.h
+ * @author IR
+ * @brief Host mock of pico/stdlib.h, only what the bootloader uses
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef unsigned int uint;
+typedef volatile uint32_t io_rw_32;
+typedef volatile uint32_t io_ro_32;
+typedef volatile uint32_t io_wo_32;
+
+#define XIP_BASE 0x10000000u
+#define XIP_NOCACHE_NOALLOC_BASE 0x13000000u
+#define SRAM_BASE 0x20000000u
+#define PPB_BASE 0xe0000000u
+#define M0PLUS_VTOR_OFFSET 0x0000ed08u
+
+#define PICO_ERROR_TIMEOUT (-1)
+#define PICO_ERROR_NO_DATA (-3)
+#define GPIO_OUT 1
+#define GPIO_IN 0
+#define GPIO_FUNC_UART 2
+#define GPIO_FUNC_PWM 4
+
+#define __not_in_flash_func(x) x
+#define __no_inline_not_in_flash_func(x) __attribute__((noinline)) x
+#define __time_critical_func(x) x
+#define __force_inline inline __attribute__((always_inline))
+#define __unused __attribute__((unused))
+#define __compiler_memory_barrier() __asm__ volatile("" ::: "memory")
+
+typedef struct {
+    io_rw_32 dbgpause;
+} timer_hw_t;
+
+extern timer_hw_t *timer_hw;
+
+void hw_set_bits(io_rw_32 *addr, uint32_t mask);
+void hw_clear_bits(io_rw_32 *addr, uint32_t mask);
+
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void tight_loop_contents(void);
+
+void gpio_init(uint gpio);
+void gpio_deinit(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+void gpio_set_function(uint gpio, uint fn);
+
+// Repeating timers fire as simulated time passes, from whatever advanced it
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t *rt);
+
+struct repeating_timer {
+    int64_t delay_us;
+    uint64_t due_us;
+    repeating_timer_callback_t callback;
+    void *user_data;
+};
+
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out);
+bool cancel_repeating_timer(repeating_timer_t *timer);
+
+bool stdio_init_all(void);
+bool stdio_usb_init(void);
+void stdio_flush(void);
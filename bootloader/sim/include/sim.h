@@ -0,0 +1,86 @@
+/**
+ * @file sim.h
+ * @author IR
+ * @brief Header file for the host simulation of the bootloader
+ * @details The Pico SDK pieces the bootloader uses are mocked on the host. Flash is a RAM array mapped at XIP_BASE,
+ * DMA transfers and the sniffer CRC complete as soon as they are triggered and stdio is a file descriptor. Time is
+ * simulated: flash operations, USB transfers and timeouts advance it by what they would take on the hardware, so
+ * throughput figures do not depend on the host.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Exit status when the bootloader asks for a watchdog reboot, it only does so when loading failed
+#define SIM_EXIT_REBOOT 4
+
+// Exit status when the host stream ends while the bootloader still waits on it
+#define SIM_EXIT_INPUT_CLOSED 3
+
+/**
+ * @brief What the simulated hardware has done so far
+ */
+typedef struct sim_stats {
+    uint64_t now_us;        // Simulated time
+    uint64_t erase_us;      // Simulated time spent erasing
+    uint64_t program_us;    // Simulated time spent programming
+    uint32_t sector_erases; // 4K sector erases issued
+    uint32_t block_erases;  // 32K/64K block erases issued
+    uint32_t page_programs; // 256B page programs issued
+    uint32_t page_faults;   // Page programs that left a byte unprogrammed, see sim_flash_set_faults
+    uint64_t bytes_in;      // Bytes consumed from the host stream
+    uint64_t bytes_out;     // Bytes written to the host stream
+} sim_stats_t;
+
+extern sim_stats_t sim_stats;
+
+/**
+ * @brief Map the simulated flash at XIP_BASE, erased
+ */
+void sim_flash_init(void);
+
+/**
+ * @brief Make page programs fail the way a marginal write does, leaving a byte that should change as it was
+ *
+ * @param every Every this many page programs fails, 0 for none
+ */
+void sim_flash_set_faults(uint32_t every);
+
+/**
+ * @brief Connect the simulated USB CDC stream
+ *
+ * @param in_fd Host to device data
+ * @param out_fd Device to host data, -1 to discard it
+ * @param tty Whether the stream is a pseudo terminal, the host may close and reopen it at any time
+ */
+void sim_io_open(int in_fd, int out_fd, bool tty);
+
+/**
+ * @brief Take characters the host has sent down the simulated UART, without waiting
+ *
+ * @param dst Buffer to copy into
+ * @param max Most characters to take
+ * @return size_t Characters taken, time moves on by how long they took on the wire
+ */
+size_t sim_uart_receive(uint8_t *dst, size_t max);
+
+/**
+ * @brief Move simulated time forward
+ *
+ * @param us Microseconds to advance by
+ */
+void sim_advance_us(uint64_t us);
+
+/**
+ * @brief Make the next boot look like a watchdog reset or a power on
+ *
+ * @param warm Whether RAM survived, the same as after a watchdog reset
+ */
+void sim_set_warm(bool warm);
@@ -0,0 +1,303 @@
+/**
+ * @file sim_dma.c
+ * @author IR
+ * @brief Source file for the host mock of hardware/dma
+ * @details Transfers complete as soon as they are triggered. The sniffer computes the same CRC32 as the hardware
+ * in mode 0x1, including the output bit reversal and inversion. Channels paced by a UART's RX DREQ instead take
+ * whatever the host has sent whenever their registers are looked at, which is the only way software can tell
+ * how far they got.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <hardware/dma.h>
+#include <hardware/uart.h>
+#include <stdlib.h>
+
+#include "sim.h"
+
+typedef struct sim_channel {
+    bool claimed;
+    dma_channel_config config;
+    dma_channel_hw_t hw;
+    uintptr_t read_addr;
+    uintptr_t write_addr;
+} sim_channel_t;
+
+#define CTRL_SIZE_MASK 0x3u
+#define CTRL_READ_INC 0x4u
+#define CTRL_WRITE_INC 0x8u
+#define CTRL_RING_SHIFT 4u
+#define CTRL_RING_MASK (0xFu << CTRL_RING_SHIFT)
+#define CTRL_RING_WRITE 0x100u
+#define CTRL_DREQ_SHIFT 9u
+#define CTRL_DREQ_MASK (0x3Fu << CTRL_DREQ_SHIFT)
+
+static sim_channel_t channels[NUM_DMA_CHANNELS];
+static dma_hw_t dma_regs;
+dma_hw_t *dma_hw = &dma_regs;
+
+static struct {
+    bool enabled;
+    int channel;
+    uint mode;
+    bool bswap;
+    uint32_t acc;
+} sniffer;
+
+static uint32_t crc_table[256];
+
+static uint32_t bitrev(uint32_t v) {
+    uint32_t r = 0;
+    for (int i = 0; i < 32; i++, v >>= 1)
+        r = (r << 1) | (v & 1);
+    return r;
+}
+
+static void crc_table_init(void) {
+    if (crc_table[1])
+        return;
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+// Mode 0x1 feeds bit-reversed data into a CRC-32, which is the reflected (zlib) CRC on the reversed register
+static void sniff_byte(uint8_t b) {
+    switch (sniffer.mode) {
+        case 0x1: {
+            uint32_t r = bitrev(sniffer.acc);
+            r = crc_table[(r ^ b) & 0xFF] ^ (r >> 8);
+            sniffer.acc = bitrev(r);
+            break;
+        }
+        case 0xF:
+            sniffer.acc += b;
+            break;
+        default:
+            fprintf(stderr, "sim_dma: unsupported sniffer mode 0x%x\n", sniffer.mode);
+            abort();
+    }
+}
+
+static void sniff(uint32_t data, uint size) {
+    if (size == 1) {
+        sniff_byte(data);
+        return;
+    }
+    if (sniffer.mode == 0xF) {
+        sniffer.acc += data;
+        return;
+    }
+    for (uint i = 0; i < size; i++) {
+        uint shift = sniffer.bswap ? (size - 1 - i) * 8 : i * 8;
+        sniff_byte((data >> shift) & 0xFF);
+    }
+}
+
+static bool uart_paced(const sim_channel_t *c) {
+    uint dreq = (c->config.ctrl & CTRL_DREQ_MASK) >> CTRL_DREQ_SHIFT;
+    return (dreq == DREQ_UART0_RX) || (dreq == DREQ_UART1_RX);
+}
+
+// Move what has arrived on the UART into a paced channel's destination, wrapping the write address on its ring
+static void pump(sim_channel_t *c) {
+    uint8_t buf[256];
+    uint ring_bits = (c->config.ctrl & CTRL_RING_MASK) >> CTRL_RING_SHIFT;
+    uintptr_t ring_mask = ring_bits ? ((uintptr_t)1 << ring_bits) - 1 : ~(uintptr_t)0;
+
+    while (c->hw.transfer_count) {
+        size_t n = sim_uart_receive(buf, (c->hw.transfer_count < sizeof(buf)) ? c->hw.transfer_count : sizeof(buf));
+        if (n == 0)
+            break;
+
+        for (size_t i = 0; i < n; i++) {
+            *(volatile uint8_t *)c->write_addr = buf[i];
+            if (c->config.ctrl & CTRL_WRITE_INC)
+                c->write_addr = (c->write_addr & ~ring_mask) | ((c->write_addr + 1) & ring_mask);
+        }
+        c->hw.transfer_count -= n;
+    }
+    c->hw.write_addr = (uint32_t)c->write_addr;
+}
+
+static void run(uint ch) {
+    sim_channel_t *c = &channels[ch];
+
+    if (uart_paced(c)) {
+        pump(c);
+        return;
+    }
+
+    uint size = 1u << (c->config.ctrl & CTRL_SIZE_MASK);
+    uint32_t count = c->hw.transfer_count;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t v = 0;
+        const volatile uint8_t *src = (const volatile uint8_t *)c->read_addr;
+        volatile uint8_t *dst = (volatile uint8_t *)c->write_addr;
+        for (uint b = 0; b < size; b++)
+            v |= (uint32_t)src[b] << (8 * b);
+        for (uint b = 0; b < size; b++)
+            dst[b] = v >> (8 * b);
+        if (sniffer.enabled && sniffer.channel == (int)ch)
+            sniff(v, size);
+        if (c->config.ctrl & CTRL_READ_INC)
+            c->read_addr += size;
+        if (c->config.ctrl & CTRL_WRITE_INC)
+            c->write_addr += size;
+    }
+    // Roughly XIP streaming speed for reads out of flash
+    if (c->config.ctrl & CTRL_READ_INC)
+        sim_advance_us((count * size) / 16);
+    c->hw.read_addr = (uint32_t)c->read_addr;
+    c->hw.write_addr = (uint32_t)c->write_addr;
+}
+
+int dma_claim_unused_channel(bool required) {
+    for (int i = 0; i < NUM_DMA_CHANNELS; i++) {
+        if (!channels[i].claimed) {
+            channels[i].claimed = true;
+            return i;
+        }
+    }
+    if (required) {
+        fprintf(stderr, "sim_dma: no channels left\n");
+        abort();
+    }
+    return -1;
+}
+
+void dma_channel_unclaim(uint channel) {
+    channels[channel].claimed = false;
+}
+
+void dma_channel_cleanup(uint channel) {
+    (void)channel;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    (void)channel;
+    crc_table_init();
+    return (dma_channel_config){DMA_SIZE_32 | CTRL_READ_INC};
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->ctrl = (c->ctrl & ~CTRL_SIZE_MASK) | size;
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->ctrl = incr ? c->ctrl | CTRL_READ_INC : c->ctrl & ~CTRL_READ_INC;
+}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->ctrl = incr ? c->ctrl | CTRL_WRITE_INC : c->ctrl & ~CTRL_WRITE_INC;
+}
+
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) {
+    (void)c;
+    (void)chain_to;
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->ctrl = (c->ctrl & ~CTRL_DREQ_MASK) | ((dreq << CTRL_DREQ_SHIFT) & CTRL_DREQ_MASK);
+}
+
+void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) {
+    // Only write rings are modelled, which is all the UART transport uses
+    c->ctrl = (c->ctrl & ~(CTRL_RING_MASK | CTRL_RING_WRITE)) | ((size_bits << CTRL_RING_SHIFT) & CTRL_RING_MASK);
+    if (write)
+        c->ctrl |= CTRL_RING_WRITE;
+}
+
+void channel_config_set_high_priority(dma_channel_config *c, bool high_priority) {
+    (void)c;
+    (void)high_priority;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr, const volatile void *read_addr, uint transfer_count, bool trigger) {
+    sim_channel_t *c = &channels[channel];
+    c->config = *config;
+    c->write_addr = (uintptr_t)write_addr;
+    c->read_addr = (uintptr_t)read_addr;
+    c->hw.transfer_count = transfer_count;
+    if (trigger)
+        run(channel);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+    channels[channel].read_addr = (uintptr_t)read_addr;
+    if (trigger)
+        run(channel);
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger) {
+    channels[channel].write_addr = (uintptr_t)write_addr;
+    if (trigger)
+        run(channel);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+    channels[channel].hw.transfer_count = trans_count;
+    if (trigger)
+        run(channel);
+}
+
+void dma_channel_start(uint channel) {
+    run(channel);
+}
+
+void dma_channel_abort(uint channel) {
+    if (uart_paced(&channels[channel]))
+        channels[channel].hw.transfer_count = 0;
+}
+
+bool dma_channel_is_busy(uint channel) {
+    return uart_paced(&channels[channel]) && channels[channel].hw.transfer_count;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel) {
+    (void)channel;
+}
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel) {
+    if (uart_paced(&channels[channel]))
+        pump(&channels[channel]);
+    return &channels[channel].hw;
+}
+
+void dma_sniffer_enable(uint channel, uint mode, bool force_channel_enable) {
+    (void)force_channel_enable;
+    sniffer.enabled = true;
+    sniffer.channel = channel;
+    sniffer.mode = mode;
+    dma_regs.sniff_ctrl = 0;
+}
+
+void dma_sniffer_disable(void) {
+    sniffer.enabled = false;
+    dma_regs.sniff_ctrl = 0;
+}
+
+void dma_sniffer_set_byte_swap_enabled(bool swap) {
+    sniffer.bswap = swap;
+}
+
+void dma_sniffer_set_data_accumulator(uint32_t seed_value) {
+    sniffer.acc = seed_value;
+}
+
+uint32_t dma_sniffer_get_data_accumulator(void) {
+    uint32_t v = sniffer.acc;
+    if (dma_regs.sniff_ctrl & DMA_SNIFF_CTRL_OUT_REV_BITS)
+        v = bitrev(v);
+    if (dma_regs.sniff_ctrl & DMA_SNIFF_CTRL_OUT_INV_BITS)
+        v = ~v;
+    return v;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file sim_flash.c
+ * @author IR
+ * @brief Source file for the host mock of hardware/flash
+ * @details Flash is a RAM array mapped at XIP_BASE and XIP_NOCACHE_NOALLOC_BASE. Erases and page programs take the typical
+ * W25Q16JV times and programming can only clear bits, the same as NOR flash.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#define _GNU_SOURCE
+#include <hardware/flash.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#define SIM_FLASH_SIZE (2048u * 1024u)
+
+// Typical W25Q16JV timings
+#define SIM_SECTOR_ERASE_US 45000u
+#define SIM_BLOCK32_ERASE_US 120000u
+#define SIM_BLOCK64_ERASE_US 150000u
+#define SIM_PAGE_PROGRAM_US 400u
+
+static uint8_t *flash_mem;
+static uint32_t fault_every; // Every this many page programs fails, 0 for none
+
+void sim_flash_set_faults(uint32_t every) {
+    fault_every = every;
+}
+
+void sim_flash_init(void) {
+    int fd = memfd_create("sim_flash", 0);
+    if (fd < 0 || ftruncate(fd, SIM_FLASH_SIZE)) {
+        perror("sim_flash");
+        exit(1);
+    }
+
+    // Cached and uncached XIP windows alias the same storage, like on the RP2040
+    flash_mem = mmap((void *)(uintptr_t)XIP_BASE, SIM_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    void *nocache = mmap((void *)(uintptr_t)XIP_NOCACHE_NOALLOC_BASE, SIM_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    if (flash_mem != (void *)(uintptr_t)XIP_BASE || nocache != (void *)(uintptr_t)XIP_NOCACHE_NOALLOC_BASE) {
+        fprintf(stderr, "sim_flash: unable to map flash at XIP_BASE\n");
+        exit(1);
+    }
+    close(fd);
+
+    memset(flash_mem, 0xFF, SIM_FLASH_SIZE);
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    if ((flash_offs % FLASH_SECTOR_SIZE) || (count % FLASH_SECTOR_SIZE) || flash_offs + count > SIM_FLASH_SIZE) {
+        fprintf(stderr, "sim_flash: bad erase 0x%08x +%zu\n", flash_offs, count);
+        abort();
+    }
+
+    // Mirror the boot ROM: 64K block erases where aligned, 4K sectors otherwise
+    while (count) {
+        uint64_t t;
+        size_t step;
+        if (!(flash_offs % FLASH_BLOCK_SIZE) && count >= FLASH_BLOCK_SIZE) {
+            step = FLASH_BLOCK_SIZE;
+            t = SIM_BLOCK64_ERASE_US;
+            sim_stats.block_erases++;
+        } else {
+            step = FLASH_SECTOR_SIZE;
+            t = SIM_SECTOR_ERASE_US;
+            sim_stats.sector_erases++;
+        }
+        memset(flash_mem + flash_offs, 0xFF, step);
+        sim_stats.erase_us += t;
+        sim_advance_us(t);
+        flash_offs += step;
+        count -= step;
+    }
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    if ((flash_offs % FLASH_PAGE_SIZE) || (count % FLASH_PAGE_SIZE) || flash_offs + count > SIM_FLASH_SIZE) {
+        fprintf(stderr, "sim_flash: bad program 0x%08x +%zu\n", flash_offs, count);
+        abort();
+    }
+
+    // NOR flash can only clear bits
+    for (size_t page = 0; page < count; page += FLASH_PAGE_SIZE) {
+        bool fault = fault_every && !((sim_stats.page_programs + (page / FLASH_PAGE_SIZE) + 1) % fault_every);
+
+        for (size_t i = page; i < page + FLASH_PAGE_SIZE; i++) {
+            uint8_t *cell = &flash_mem[flash_offs + i];
+
+            // The first byte that should change is left as it was
+            if (fault && ((*cell & data[i]) != *cell)) {
+                fault = false;
+                sim_stats.page_faults++;
+                continue;
+            }
+            *cell &= data[i];
+        }
+    }
+
+    sim_stats.page_programs += count / FLASH_PAGE_SIZE;
+    sim_stats.program_us += (count / FLASH_PAGE_SIZE) * SIM_PAGE_PROGRAM_US;
+    sim_advance_us((count / FLASH_PAGE_SIZE) * SIM_PAGE_PROGRAM_US);
+}
+
+// Just enough of the SPI command set for the block erases the bootloader issues itself
+void flash_do_cmd(const uint8_t *txbuf, uint8_t *rxbuf, size_t count) {
+    static bool write_enabled;
+
+    memset(rxbuf, 0, count);
+    switch (txbuf[0]) {
+        case 0x06:
+            write_enabled = true;
+            break;
+        case 0x05:
+            break;
+        case 0x52:
+        case 0xD8: {
+            uint32_t size = (txbuf[0] == 0x52) ? 32768u : 65536u;
+            uint32_t offs = (txbuf[1] << 16) | (txbuf[2] << 8) | txbuf[3];
+            uint64_t t = (txbuf[0] == 0x52) ? SIM_BLOCK32_ERASE_US : SIM_BLOCK64_ERASE_US;
+            if (!write_enabled || (offs % size) || offs + size > SIM_FLASH_SIZE) {
+                fprintf(stderr, "sim_flash: bad block erase 0x%08x\n", offs);
+                abort();
+            }
+            write_enabled = false;
+            memset(flash_mem + offs, 0xFF, size);
+            sim_stats.block_erases++;
+            sim_stats.erase_us += t;
+            sim_advance_us(t);
+            break;
+        }
+        default:
+            fprintf(stderr, "sim_flash: unknown command 0x%02x\n", txbuf[0]);
+            abort();
+    }
+}
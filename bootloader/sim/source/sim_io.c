@@ -0,0 +1,439 @@
+/**
+ * @file sim_io.c
+ * @author IR
+ * @brief Source file for the host mock of stdio, uart, time, timers, gpio, pwm and watchdog
+ * @details The stdio_usb driver is the simulated USB CDC stream. Every byte moving across it costs SIM_USB_BYTE_NS and
+ * every change of direction costs SIM_USB_TURNAROUND_US, which is what round-trip protocols pay on the real link.
+ *
+ * The UART carries the same host stream instead when the bootloader is built for it. Characters come in back to
+ * back at the baud rate from the moment the host has sent something, and only in simulated time, so they pile up
+ * in the DMA ring while flash is busy the same as on the hardware. Waiting in tight_loop_contents moves time on to
+ * the next character.
+ *
+ * A file has no host behind it to wait for replies. For the HEX and BIN schemes it is sent a line or record at a time,
+ * each once the bootloader has prompted for it with a 0, the same as their host scripts.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <errno.h>
+#include <hardware/pwm.h>
+#include <hardware/uart.h>
+#include <hardware/watchdog.h>
+#include <pico/stdio_usb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bin.h"
+#include "boot_info.h"
+#include "sim.h"
+
+// Full speed CDC tops out somewhere around 1MB/s
+#define SIM_USB_BYTE_NS 1000u
+
+// Data only moves on the next 1ms USB frame once the other side has answered
+#define SIM_USB_TURNAROUND_US 1000u
+
+sim_stats_t sim_stats;
+
+static int in_fd = -1;
+static int out_fd = -1;
+static bool in_tty;
+static bool last_out; // Whether the last byte on the stream went to the host
+static uint64_t byte_ns;
+
+static watchdog_hw_t watchdog_regs;
+watchdog_hw_t *watchdog_hw = &watchdog_regs;
+
+static timer_hw_t timer_regs;
+timer_hw_t *timer_hw = &timer_regs;
+
+static bool warm;
+static bool gpio_state[32];
+static uint16_t gpio_level[32];
+
+static uint8_t host_buf[4096]; // Sent by the host, not received yet
+static size_t host_len;
+static size_t host_pos;
+static bool host_closed;
+static uint32_t host_prompts;   // Lines or records a file host has been asked for and not sent yet
+static uint64_t host_prompt_ns; // Simulated time the host answers the last prompt
+
+static uart_hw_t uart_regs[2];
+static uint64_t uart_byte_ns; // Time a character takes on the wire, start and stop bit included
+static uint64_t uart_rx_ns;   // Simulated time the character on the RX line finishes, 0 while it is idle
+static uint64_t uart_tx_ns;   // Simulated time everything written to the TX FIFO has gone out
+
+// Only the bootloader's LED timer is ever running
+static repeating_timer_t *timer;
+static bool in_timer;
+
+// Placed at the end of RAM by the linker scripts on the Pico, here it is just kept across bootloader runs
+boot_info_t __boot_info;
+
+void sim_io_open(int in, int out, bool tty) {
+    in_fd = in;
+    out_fd = out;
+    in_tty = tty;
+}
+
+void sim_advance_us(uint64_t us) {
+    sim_stats.now_us += us;
+
+    // Callbacks run where they fall due, as if the interrupt had come in just then
+    while ((timer != NULL) && !in_timer && (timer->due_us <= sim_stats.now_us)) {
+        repeating_timer_t *t = timer;
+        t->due_us += (t->delay_us < 0) ? -t->delay_us : t->delay_us;
+        in_timer = true;
+        if (!t->callback(t))
+            timer = NULL;
+        in_timer = false;
+    }
+}
+
+void sim_set_warm(bool w) {
+    warm = w;
+}
+
+// Account for one byte crossing the link in either direction
+static void sim_usb_byte(bool out) {
+    if (out != last_out) {
+        sim_advance_us(SIM_USB_TURNAROUND_US);
+        last_out = out;
+    }
+
+    byte_ns += SIM_USB_BYTE_NS;
+    sim_advance_us(byte_ns / 1000u);
+    byte_ns %= 1000u;
+}
+
+void hw_set_bits(io_rw_32 *addr, uint32_t mask) {
+    // Core peripheral (NVIC, SysTick) writes have nothing to act on here
+    if ((uintptr_t)addr >= PPB_BASE && (uintptr_t)addr <= 0xFFFFFFFFu)
+        return;
+    *addr |= mask;
+}
+
+void hw_clear_bits(io_rw_32 *addr, uint32_t mask) {
+    if ((uintptr_t)addr >= PPB_BASE && (uintptr_t)addr <= 0xFFFFFFFFu)
+        return;
+    *addr &= ~mask;
+}
+
+void sleep_ms(uint32_t ms) {
+    sim_advance_us((uint64_t)ms * 1000u);
+}
+
+void sleep_us(uint64_t us) {
+    sim_advance_us(us);
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t)sim_stats.now_us;
+}
+
+uint64_t time_us_64(void) {
+    return sim_stats.now_us;
+}
+
+static uint64_t now_ns(void) {
+    return sim_stats.now_us * 1000u;
+}
+
+// Whether the host is a file sent a line or record per prompt
+static bool host_lockstep(void) {
+#if defined(BOOT_INPUT_HEX) || defined(BOOT_INPUT_BIN)
+    return !in_tty;
+#else
+    return false;
+#endif
+}
+
+// Whether c, the next character from a file host, ends what it was prompted for
+static bool host_ends(uint8_t c) {
+#if defined(BOOT_INPUT_HEX)
+    return c == '\n';
+#elif defined(BOOT_INPUT_BIN)
+    static uint32_t host_sent;   // Bytes of the current record sent
+    static uint32_t host_length; // Length of the current record, once its header has been sent
+
+    host_sent++;
+    if (host_sent == sizeof(bin_header_t) - 1)
+        host_length = c;
+    else if (host_sent == sizeof(bin_header_t))
+        host_length = sizeof(bin_header_t) + (host_length | (c << 8));
+
+    if ((host_sent < sizeof(bin_header_t)) || (host_sent < host_length))
+        return false;
+    host_sent = 0;
+    return true;
+#else
+    (void)c;
+    return false;
+#endif
+}
+
+// Pull what the host has sent so far into host_buf, waiting up to timeout_ms for something
+static bool host_fill(int timeout_ms) {
+    if (host_pos < host_len)
+        return true;
+    if ((in_fd < 0) || host_closed)
+        return false;
+
+    struct pollfd p = {.fd = in_fd, .events = POLLIN};
+    if (poll(&p, 1, timeout_ms) <= 0)
+        return false;
+
+    ssize_t n = read(in_fd, host_buf, sizeof(host_buf));
+    if ((n < 0) && in_tty && (errno == EIO)) {
+        // Nothing has the terminal open, the same as the port being closed on the host
+        usleep(1000);
+        return false;
+    }
+    if (n <= 0) {
+        host_closed = true;
+        return false;
+    }
+
+    host_len = n;
+    host_pos = 0;
+    return true;
+}
+
+// Whether the host is sending something at the simulated time at_ns
+static bool host_ready(uint64_t at_ns) {
+    if (host_lockstep() && ((host_prompts == 0) || (host_prompt_ns > at_ns)))
+        return false;
+    return host_fill(0);
+}
+
+static uint8_t host_take(void) {
+    uint8_t c = host_buf[host_pos++];
+    if (host_lockstep() && host_ends(c) && host_prompts)
+        host_prompts--;
+    return c;
+}
+
+// The host sees a character from the bootloader at the simulated time at_ns
+static void host_receive(uint8_t c, uint64_t at_ns) {
+    if (host_lockstep() && (c == 0)) {
+        host_prompts++;
+        host_prompt_ns = at_ns;
+    }
+}
+
+/**
+ * @brief Let time pass while the bootloader waits on the host, input is only given up on once it does
+ *
+ * @param next_ns Simulated time the next character is already on its way for, 0 if none is
+ */
+static void host_wait(uint64_t next_ns) {
+    if (next_ns > now_ns()) {
+        sim_advance_us((next_ns - now_ns() + 999u) / 1000u);
+        return;
+    }
+
+    if (host_lockstep()) {
+        if (host_prompts == 0) {
+            fprintf(stderr, "sim: waiting on input without asking for it\n");
+            exit(SIM_EXIT_INPUT_CLOSED);
+        }
+        if (host_prompt_ns > now_ns()) {
+            sim_advance_us((host_prompt_ns - now_ns() + 999u) / 1000u);
+            return;
+        }
+    }
+
+    if (host_fill(1))
+        return;
+    if (host_closed || (in_fd < 0)) {
+        fprintf(stderr, "sim: input closed\n");
+        exit(SIM_EXIT_INPUT_CLOSED);
+    }
+    sim_advance_us(1000u);
+}
+
+size_t sim_uart_receive(uint8_t *dst, size_t max) {
+    size_t n = 0;
+
+    while (n < max) {
+        if (uart_rx_ns == 0) {
+            // The line was idle, a prompted line has been arriving since the host answered
+            if (!host_ready(now_ns()))
+                break;
+            uart_rx_ns = (host_lockstep() ? host_prompt_ns : now_ns()) + uart_byte_ns;
+        }
+        if (uart_rx_ns > now_ns())
+            break;
+
+        dst[n++] = host_take();
+        uart_rx_ns = host_ready(uart_rx_ns) ? uart_rx_ns + uart_byte_ns : 0;
+    }
+
+    sim_stats.bytes_in += n;
+    return n;
+}
+
+// The transports spin on this waiting for characters to arrive
+void tight_loop_contents(void) {
+    host_wait(uart_rx_ns);
+}
+
+void gpio_init(uint gpio) {
+    gpio_state[gpio & 31] = false;
+}
+
+void gpio_deinit(uint gpio) {
+    gpio_state[gpio & 31] = false;
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+    (void)gpio;
+    (void)out;
+}
+
+void gpio_put(uint gpio, bool value) {
+    gpio_state[gpio & 31] = value;
+}
+
+bool gpio_get(uint gpio) {
+    return gpio_state[gpio & 31];
+}
+
+void gpio_set_function(uint gpio, uint fn) {
+    (void)gpio;
+    (void)fn;
+}
+
+void pwm_init(uint slice_num, pwm_config *c, bool start) {
+    (void)slice_num;
+    (void)c;
+    (void)start;
+}
+
+void pwm_set_enabled(uint slice_num, bool enabled) {
+    (void)slice_num;
+    (void)enabled;
+}
+
+void pwm_set_gpio_level(uint gpio, uint16_t level) {
+    gpio_level[gpio & 31] = level;
+}
+
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out) {
+    out->delay_us = (int64_t)delay_ms * 1000;
+    out->due_us = sim_stats.now_us + ((delay_ms < 0) ? -out->delay_us : out->delay_us);
+    out->callback = callback;
+    out->user_data = user_data;
+    timer = out;
+    return true;
+}
+
+bool cancel_repeating_timer(repeating_timer_t *t) {
+    if (timer != t)
+        return false;
+    timer = NULL;
+    return true;
+}
+
+bool stdio_init_all(void) {
+    return true;
+}
+
+bool stdio_usb_init(void) {
+    return true;
+}
+
+void stdio_flush(void) {
+}
+
+// The driver hands over whatever has arrived, up to len, and never waits
+static int usb_in_chars(char *buf, int len) {
+    int n = 0;
+
+    while ((n < len) && host_ready(now_ns())) {
+        buf[n++] = host_take();
+        sim_usb_byte(false);
+    }
+
+    sim_stats.bytes_in += n;
+    return n ? n : PICO_ERROR_NO_DATA;
+}
+
+static void usb_out_chars(const char *buf, int len) {
+    for (int i = 0; i < len; i++) {
+        sim_usb_byte(true);
+        host_receive(buf[i], now_ns());
+    }
+
+    sim_stats.bytes_out += len;
+    if (out_fd >= 0 && write(out_fd, buf, len) != len && !in_tty)
+        out_fd = -1;
+}
+
+static void usb_out_flush(void) {
+}
+
+stdio_driver_t stdio_usb = {.out_chars = usb_out_chars, .out_flush = usb_out_flush, .in_chars = usb_in_chars};
+
+uint uart_init(uart_inst_t *uart, uint baudrate) {
+    (void)uart;
+    uart_byte_ns = 10000000000ull / baudrate;
+    uart_rx_ns = uart_tx_ns = 0;
+    return baudrate;
+}
+
+void uart_deinit(uart_inst_t *uart) {
+    (void)uart;
+}
+
+uart_hw_t *uart_get_hw(uart_inst_t *uart) {
+    return &uart_regs[(uintptr_t)uart & 1];
+}
+
+uint uart_get_dreq(uart_inst_t *uart, bool tx) {
+    return (((uintptr_t)uart & 1) ? DREQ_UART1_TX : DREQ_UART0_TX) + !tx;
+}
+
+void uart_putc_raw(uart_inst_t *uart, char c) {
+    (void)uart;
+
+    // Blocks once the 32 character FIFO is full
+    if (uart_tx_ns > now_ns() + (32u * uart_byte_ns))
+        sim_advance_us((uart_tx_ns - now_ns() - (32u * uart_byte_ns) + 999u) / 1000u);
+    uart_tx_ns = ((uart_tx_ns > now_ns()) ? uart_tx_ns : now_ns()) + uart_byte_ns;
+
+    // A host behind a USB to serial adapter only hears about it on the next USB frame
+    host_receive(c, uart_tx_ns + (SIM_USB_TURNAROUND_US * 1000u));
+
+    sim_stats.bytes_out++;
+    if (out_fd >= 0 && write(out_fd, &c, 1) != 1 && !in_tty)
+        out_fd = -1;
+}
+
+void uart_tx_wait_blocking(uart_inst_t *uart) {
+    (void)uart;
+
+    if (uart_tx_ns > now_ns())
+        sim_advance_us((uart_tx_ns - now_ns() + 999u) / 1000u);
+}
+
+void watchdog_reboot(uint32_t pc, uint32_t sp, uint32_t delay_ms) {
+    (void)pc;
+    (void)sp;
+    (void)delay_ms;
+    fprintf(stderr, "sim: watchdog reboot requested\n");
+    exit(SIM_EXIT_REBOOT);
+}
+
+bool watchdog_caused_reboot(void) {
+    return warm;
+}
+
+bool watchdog_enable_caused_reboot(void) {
+    return false;
+}
@@ -0,0 +1,208 @@
+/**
+ * @file sim_main.c
+ * @author IR
+ * @brief Main source file for the host simulation of the bootloader
+ * @details Runs the bootloader's own main(), built as bootloader_main, against the mocked SDK and reports what it
+ * cost on the simulated hardware once it is done, however it ends.
+ *
+ *     bootloader_sim_hex -r -i build/PMPi_OUT.hex -s flash.bin
+ *     bootloader_sim_frame -r -p    then    python frame_usb.py /dev/pts/N build/PMPi_OUT.hex
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <hardware/watchdog.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bootloader.h"
+#include "sim.h"
+
+#define SIM_FLASH_IMAGE_SIZE (2048u * 1024u)
+
+// How long to wait on exit for the host to close the pseudo terminal
+#define SIM_TTY_LINGER_MS 2000
+
+int bootloader_main(void);
+
+static const char *save_path;
+static int tty_fd = -1;
+static struct timespec wall_start;
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-i FILE] [-o FILE] [-p] [-l FILE] [-s FILE] [-r] [-w] [-f N] [-c] [-q]\n"
+            "  -i FILE  read the host stream from FILE instead of stdin\n"
+            "  -o FILE  write replies to FILE instead of discarding them\n"
+            "  -p       talk to the host over a pseudo terminal, its path is printed first\n"
+            "  -l FILE  load flash from FILE before booting\n"
+            "  -s FILE  save flash to FILE on exit\n"
+            "  -r       boot as if the app asked for the bootloader\n"
+            "  -w       boot as if after a watchdog reset\n"
+            "  -f N     fail every Nth page program, leaving a byte unprogrammed\n"
+            "  -c       only check the program in flash, exit status 0 if it verifies\n"
+            "  -q       do not report statistics\n",
+            name);
+    exit(2);
+}
+
+static void flash_file(const char *path, bool save) {
+    FILE *f = fopen(path, save ? "wb" : "rb");
+    if (f == NULL) {
+        perror(path);
+        exit(2);
+    }
+
+    if (save)
+        fwrite((void *)(uintptr_t)XIP_BASE, 1, SIM_FLASH_IMAGE_SIZE, f);
+    else
+        fread((void *)(uintptr_t)XIP_BASE, 1, SIM_FLASH_IMAGE_SIZE, f);
+    fclose(f);
+}
+
+static void report(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double wall = (now.tv_sec - wall_start.tv_sec) + (now.tv_nsec - wall_start.tv_nsec) / 1e9;
+    double sim = sim_stats.now_us / 1e6;
+
+    fprintf(stderr, "sim: %llu bytes in, %llu out in %.3fs (%.1f KiB/s), %.3fs on the host\n",
+            (unsigned long long)sim_stats.bytes_in, (unsigned long long)sim_stats.bytes_out, sim,
+            sim > 0 ? (sim_stats.bytes_in / sim) / 1024 : 0.0, wall);
+    fprintf(stderr, "sim: %u sector and %u block erases in %.3fs, %u page programs in %.3fs\n",
+            sim_stats.sector_erases, sim_stats.block_erases, sim_stats.erase_us / 1e6,
+            sim_stats.page_programs, sim_stats.program_us / 1e6);
+    if (sim_stats.page_faults)
+        fprintf(stderr, "sim: %u page programs failed\n", sim_stats.page_faults);
+}
+
+static void finish(void) {
+    if (save_path != NULL)
+        flash_file(save_path, true);
+}
+
+// The hangup when the pseudo terminal closes throws away replies the host has not read yet, the last ACK among them
+static void linger(void) {
+    struct pollfd p = {.fd = tty_fd, .events = POLLIN};
+    char discard[256];
+
+    for (int waited = 0; waited < SIM_TTY_LINGER_MS; waited += 10) {
+        if ((poll(&p, 1, 10) > 0) && ((p.revents & POLLHUP) || (read(tty_fd, discard, sizeof(discard)) < 0)))
+            return;
+    }
+}
+
+static int open_pty(void) {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((fd < 0) || grantpt(fd) || unlockpt(fd)) {
+        perror("sim: pty");
+        exit(2);
+    }
+
+    // Binary data both ways, whatever the host opens it with
+    struct termios t;
+    tcgetattr(fd, &t);
+    cfmakeraw(&t);
+    tcsetattr(fd, TCSANOW, &t);
+
+    printf("%s\n", ptsname(fd));
+    fflush(stdout);
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    const char *in_path = NULL;
+    const char *out_path = NULL;
+    const char *load_path = NULL;
+    bool tty = false;
+    bool check = false;
+    bool quiet = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:o:pl:s:rwf:cq")) != -1) {
+        switch (opt) {
+            case 'i':
+                in_path = optarg;
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            case 'p':
+                tty = true;
+                break;
+            case 'l':
+                load_path = optarg;
+                break;
+            case 's':
+                save_path = optarg;
+                break;
+            case 'r':
+                watchdog_hw->scratch[0] = 1;
+                break;
+            case 'w':
+                sim_set_warm(true);
+                break;
+            case 'f':
+                sim_flash_set_faults(strtoul(optarg, NULL, 0));
+                break;
+            case 'c':
+                check = true;
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    sim_flash_init();
+    if (load_path != NULL)
+        flash_file(load_path, false);
+
+    if (check) {
+        bool ok = check_flash_crc32();
+        int32_t bad = check_flash_sectors(0);
+        fprintf(stderr, "sim: program %s", ok ? "verifies" : "does not verify");
+        if (bad >= 0)
+            fprintf(stderr, ", sector %d is the first that does not match", (int)bad);
+        fprintf(stderr, "\n");
+        return ok ? 0 : 1;
+    }
+
+    int in = STDIN_FILENO;
+    int out = -1;
+    if (tty) {
+        in = out = tty_fd = open_pty();
+        atexit(linger);
+    } else {
+        if ((in_path != NULL) && strcmp(in_path, "-") && ((in = open(in_path, O_RDONLY)) < 0)) {
+            perror(in_path);
+            return 2;
+        }
+        if ((out_path != NULL) && ((out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)) {
+            perror(out_path);
+            return 2;
+        }
+    }
+    sim_io_open(in, out, tty);
+
+    // Registered in this order so flash is saved before the report, whichever way the bootloader ends
+    if (!quiet)
+        atexit(report);
+    atexit(finish);
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    // Ends in exit() from bootloader_exit or a watchdog reboot
+    bootloader_main();
+    return 1;
+}
@@ -0,0 +1,205 @@
+"""Flash the simulation with the FRAME scheme the way frame_usb.py flashes a device, for the tests
+
+frame_usb.py's own FrameLink talks to the simulation over the pseudo terminal it serves with -p, so the window,
+NAKs, QUERY, RESUME, SECTOR, ERASE, ZDATA and FAIL handling under test are what the host script really does.
+
+    python frame_host.py flash bootloader_sim_frame image_OUT.hex -- -r -s flash.bin
+    python frame_host.py flash bootloader_sim_frame image_OUT.hex --drop 5 --corrupt 7 -- -r -s flash.bin
+    python frame_host.py flash bootloader_sim_frame image_OUT.hex --expect unchanged -- -r -l flash.bin
+    python frame_host.py flash bootloader_sim_frame image_OUT.hex --expect fail -- -r -f 1
+    python frame_host.py record image_OUT.hex cut.frm --stop 4     a fresh load cut short, for the simulation's -i
+    python frame_host.py record image_OUT.hex stray.frm --stray 0xFFFFF000     a sector of data outside of flash first
+
+--drop and --corrupt lose or damage every Nth data frame the first time it is sent, the way a bad link does.
+"""
+import argparse
+import binascii
+import os
+import select
+import subprocess
+import sys
+import time
+import tty
+import types
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..'))
+
+try:
+    import serial
+except ImportError:
+    # pyserial is only needed to open a real port, the pseudo terminal is driven through PtySerial below
+    class SerialException(Exception):
+        pass
+
+    serial = types.ModuleType('serial')
+    serial.Serial = object
+    serial.serialutil = types.SimpleNamespace(SerialException=SerialException)
+    sys.modules['serial'] = serial
+
+import frame_usb  # noqa: E402
+
+# Read timeout while waiting on frame replies, the same as frame_usb.py
+READ_TIMEOUT = 0.05
+
+# How long the simulation has to finish once the host is done
+EXIT_TIMEOUT = 30
+
+# Simulation exit status for a load that failed, it reboots into the bootloader, see sim.h
+SIM_EXIT_REBOOT = 4
+
+
+class PtySerial:
+    """The read and write FrameLink needs, on the simulation's pseudo terminal"""
+
+    def __init__(self, path: str, drop: int = 0, corrupt: int = 0):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        self.drop = drop
+        self.corrupt = corrupt
+        self.data_frames = 0
+        self.mangled = set()  # Sequence numbers already lost or damaged once, they go through when resent
+        self.dropped = 0
+        self.corrupted = 0
+
+    def read(self, size: int) -> bytes:
+        data = b''
+        deadline = time.monotonic() + READ_TIMEOUT
+        while len(data) < size:
+            left = deadline - time.monotonic()
+            if left <= 0 or not select.select([self.fd], [], [], left)[0]:
+                break
+            try:
+                chunk = os.read(self.fd, size - len(data))
+            except OSError:
+                break  # The simulation has exited
+            if not chunk:
+                break
+            data += chunk
+        return data
+
+    def write(self, data: bytes) -> None:
+        _, seq, ftype, _, _, length, _ = frame_usb.HEADER.unpack_from(data)
+        if ftype in (frame_usb.FRAME_DATA, frame_usb.FRAME_ZDATA) and seq not in self.mangled:
+            self.data_frames += 1
+            if self.drop and self.data_frames % self.drop == 0:
+                self.mangled.add(seq)
+                self.dropped += 1
+                return
+            if self.corrupt and self.data_frames % self.corrupt == 0:
+                self.mangled.add(seq)
+                self.corrupted += 1
+                at = frame_usb.HEADER.size + length // 2
+                data = data[:at] + bytes([data[at] ^ 0x40]) + data[at + 1:]
+        os.write(self.fd, data)
+
+    def close(self) -> None:
+        os.close(self.fd)
+
+
+def flash(link: frame_usb.FrameLink, hex_file: str) -> str:
+    """Flash the way frame_usb.serial_output does once the bootloader answers, returns what happened"""
+    segments = frame_usb.fill_gaps(frame_usb.clip_segments(frame_usb.read_hex(hex_file)))
+    program = frame_usb.program_id(segments)
+    if program is None:
+        raise ValueError(f"{hex_file} has no flash header")
+
+    if link.query() == program[0]:
+        link.send([(frame_usb.FRAME_END, 0, b'')])
+        return "unchanged"
+
+    sectors = frame_usb.split_segments(segments, frame_usb.SECTOR_SIZE)
+    done = link.resume(*program)
+    sectors = frame_usb.drop_resumed(sectors, done)
+
+    flashed = link.sector_crcs(sectors)
+    stale = [(address, data) for (address, data), crc in zip(sectors, flashed) if crc != binascii.crc32(data)]
+
+    frames = [(frame_usb.FRAME_ERASE, address, b'', count) for address, count in frame_usb.erase_runs(stale)]
+    frames += frame_usb.compress_segments(frame_usb.merge_segments(stale), link.payload_max)
+    frames.append((frame_usb.FRAME_END, 0, b''))
+    link.send(frames)
+
+    print(f"frame_host: {len(stale)} of {len(sectors)} sectors sent")
+    return "resumed" if done else "loaded"
+
+
+def run_flash(args: argparse.Namespace) -> int:
+    sim = subprocess.Popen([args.sim, '-p'] + args.sim_args, stdout=subprocess.PIPE, text=True)
+    ser = PtySerial(sim.stdout.readline().strip(), args.drop, args.corrupt)
+    link = frame_usb.FrameLink(ser)
+    link.progress = False
+
+    try:
+        link.hello()
+        result = flash(link, args.hex)
+    except serial.serialutil.SerialException as e:
+        result = "fail"
+        print(f"frame_host: {e}")
+        if "would not program" not in str(e):
+            # Only a page that would not program is an expected failure, a lost session never is
+            result = "lost"
+
+    # The simulation waits for the port to close before it exits, the same as a device would be unplugged
+    ser.close()
+    try:
+        status = sim.wait(EXIT_TIMEOUT)
+    except subprocess.TimeoutExpired:
+        sim.kill()
+        status = None
+
+    print(f"frame_host: {result}, {ser.dropped} frames dropped, {ser.corrupted} corrupted, simulation exit {status}")
+    if ser.dropped < (1 if args.drop else 0) or ser.corrupted < (1 if args.corrupt else 0):
+        print("frame_host: the link was not disturbed as asked")
+        return 1
+    if result != args.expect:
+        print(f"frame_host: expected {args.expect}")
+        return 1
+    return 0 if status == (SIM_EXIT_REBOOT if result == "fail" else 0) else 1
+
+
+def run_record(args: argparse.Namespace) -> int:
+    """Write what a fresh load sends, the bootloader takes a stream of frames in order without waiting on replies"""
+    segments = frame_usb.fill_gaps(frame_usb.clip_segments(frame_usb.read_hex(args.hex)))
+    sectors = frame_usb.split_segments(segments, frame_usb.SECTOR_SIZE)
+
+    frames = [(frame_usb.FRAME_ERASE, address, b'', count) for address, count in frame_usb.erase_runs(sectors)]
+    frames += frame_usb.compress_segments(segments, frame_usb.SECTOR_SIZE)
+    frames.append((frame_usb.FRAME_END, 0, b''))
+    frames = frames[:args.stop]
+    if args.stray is not None:
+        frames.insert(0, (frame_usb.FRAME_DATA, args.stray, bytes(frame_usb.SECTOR_SIZE)))
+
+    wire = [frame_usb.build_frame(0, frame_usb.FRAME_HELLO)]
+    wire += [frame_usb.build_frame(1 + i, *frame) for i, frame in enumerate(frames)]
+    with open(args.out, 'wb') as file:
+        file.write(b''.join(wire))
+    return 0
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    p = sub.add_parser('flash', help="Flash the simulation over its pseudo terminal")
+    p.add_argument('sim', help="bootloader_sim_frame or bootloader_sim_frame_uart")
+    p.add_argument('hex', help="_OUT.hex to flash")
+    p.add_argument('--drop', type=int, default=0, help="Lose every Nth data frame the first time it is sent")
+    p.add_argument('--corrupt', type=int, default=0, help="Damage every Nth data frame the first time it is sent")
+    p.add_argument('--expect', choices=['loaded', 'resumed', 'unchanged', 'fail'], default='loaded', help="How the load has to go")
+
+    p = sub.add_parser('record', help="Write the frames of a fresh load to a file")
+    p.add_argument('hex', help="_OUT.hex to send")
+    p.add_argument('out', help="File to write the frames to")
+    p.add_argument('--stop', type=int, help="Only write this many frames after the HELLO, the load is not ended")
+    p.add_argument('--stray', type=lambda s: int(s, 0), help="Send a sector of data at this address before anything else")
+
+    # Everything after -- is for the simulation
+    argv = sys.argv[1:]
+    split = argv.index('--') if '--' in argv else len(argv)
+    args = parser.parse_args(argv[:split])
+    args.sim_args = argv[split + 1:]
+    return run_flash(args) if args.command == 'flash' else run_record(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
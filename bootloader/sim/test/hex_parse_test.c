@@ -0,0 +1,158 @@
+/**
+ * @file hex_parse_test.c
+ * @author IR
+ * @brief Checks the bootloader's Intel HEX record parser on the host
+ * @details Records are fed to hex_parse in every chunk size from a character at a time up to the whole record,
+ * the way they arrive from the transport, and what it makes of them is checked against what they hold.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hex.h"
+
+static int failed;
+
+#define CHECK(cond, ...)                                       \
+    do {                                                       \
+        if (!(cond)) {                                         \
+            fprintf(stderr, "hex_parse_test:%d: ", __LINE__);  \
+            fprintf(stderr, __VA_ARGS__);                      \
+            fputc('\n', stderr);                               \
+            failed++;                                          \
+        }                                                      \
+    } while (0)
+
+// An example record from the Intel HEX specification, 16 data bytes at 0x0100
+static const char *const RECORD = ":10010000214601360121470136007EFE09D2190140";
+static const uint8_t RECORD_DATA[16] = {0x21, 0x46, 0x01, 0x36, 0x01, 0x21, 0x47, 0x01, 0x36, 0x00, 0x7E, 0xFE, 0x09, 0xD2, 0x19, 0x01};
+
+/**
+ * @brief Feed a string to the parser a chunk at a time until it stops on a record or an invalid one
+ *
+ * @param src Characters to parse
+ * @param chunk Most characters handed to hex_parse at a time
+ * @param consumed Set to the characters consumed up to where it stopped
+ * @return HexStatus HEX_Pending if it ran out of characters first
+ */
+static HexStatus feed(const char *src, uint32_t chunk, uint32_t *consumed) {
+    uint32_t len = strlen(src);
+    uint32_t pos = 0;
+    HexStatus status = HEX_Pending;
+
+    while ((pos < len) && (status == HEX_Pending)) {
+        uint32_t n = (len - pos < chunk) ? len - pos : chunk;
+        uint32_t used;
+
+        status = hex_parse(src + pos, n, &used);
+        CHECK(used <= n, "used %u of %u characters", used, n);
+        CHECK((status != HEX_Pending) || (used == n), "pending with %u of %u characters used", used, n);
+        pos += used;
+    }
+
+    *consumed = pos;
+    return status;
+}
+
+static void check_record(const char *name, uint8_t count, uint16_t address, HexType type, const uint8_t *data) {
+    CHECK(HEX.count == count, "%s: count %u, expected %u", name, HEX.count, count);
+    CHECK(HEX.address == address, "%s: address 0x%04x, expected 0x%04x", name, HEX.address, address);
+    CHECK(HEX.type == type, "%s: type %u, expected %u", name, HEX.type, type);
+    CHECK(memcmp(HEX.data, data, count) == 0, "%s: data differs", name);
+}
+
+// Every chunk size, down to a character at a time, has to stop exactly at the end of the record
+static void test_chunks(const char *name, const char *src, uint8_t count, uint16_t address, HexType type, const uint8_t *data) {
+    uint32_t len = strlen(src);
+
+    for (uint32_t chunk = 1; chunk <= len; chunk++) {
+        uint32_t used;
+
+        hex_parse_reset();
+        memset(&HEX, 0, sizeof(HEX));
+        HexStatus status = feed(src, chunk, &used);
+        CHECK(status == HEX_Record, "%s in chunks of %u: status %d", name, chunk, status);
+        CHECK(used == len, "%s in chunks of %u: stopped after %u of %u characters", name, chunk, used, len);
+        check_record(name, count, address, type, data);
+    }
+}
+
+static void test_invalid(const char *name, const char *src, uint32_t stop) {
+    uint32_t used;
+
+    hex_parse_reset();
+    HexStatus status = feed(src, strlen(src), &used);
+    CHECK(status == HEX_Invalid, "%s: status %d", name, status);
+    CHECK(used == stop, "%s: stopped after %u characters, expected %u", name, used, stop);
+
+    // The parser waits for the next start code, a good record after it still parses
+    status = feed(RECORD, strlen(RECORD), &used);
+    CHECK(status == HEX_Record, "%s: record after it, status %d", name, status);
+}
+
+int main(void) {
+    char line[600];
+    uint32_t used;
+
+    test_chunks("record", RECORD, 16, 0x0100, HEX_Data, RECORD_DATA);
+
+    // Lowercase digits are as good as uppercase
+    for (uint32_t i = 0; i <= strlen(RECORD); i++)
+        line[i] = tolower(RECORD[i]);
+    test_chunks("lowercase", line, 16, 0x0100, HEX_Data, RECORD_DATA);
+
+    test_chunks("end of file", ":00000001FF", 0, 0x0000, HEX_EndOfFile, RECORD_DATA);
+    test_chunks("extended linear address", ":020000041000EA", 2, 0x0000, HEX_ExtendedLinearAddress, (const uint8_t[]){0x10, 0x00});
+
+    // The longest record there is, data[] has to hold all of it
+    uint8_t data[255];
+    uint8_t sum = (uint8_t)(255 + 0x12 + 0x34);
+    int n = sprintf(line, ":FF123400");
+    for (int i = 0; i < 255; i++) {
+        data[i] = i ^ 0x5A;
+        sum += data[i];
+        n += sprintf(line + n, "%02X", data[i]);
+    }
+    sprintf(line + n, "%02X", (uint8_t)-sum);
+    test_chunks("255 byte record", line, 255, 0x1234, HEX_Data, data);
+
+    // Line endings and noise between records are skipped, records are taken one at a time
+    hex_parse_reset();
+    snprintf(line, sizeof(line), "\r\n%s\r\n%s\r\n", RECORD, ":00000001FF");
+    CHECK(hex_parse(line, strlen(line), &used) == HEX_Record, "first of two records");
+    CHECK(used == 2 + strlen(RECORD), "first of two records: stopped after %u characters", used);
+    uint32_t at = used;
+    CHECK(hex_parse(line + at, strlen(line) - at, &used) == HEX_Record, "second of two records");
+    CHECK(HEX.type == HEX_EndOfFile, "second of two records: type %u", HEX.type);
+    CHECK(hex_parse(line + at + used, strlen(line) - at - used, &used) == HEX_Pending, "after two records");
+
+    // A checksum or a data byte one off
+    test_invalid("bad checksum", ":10010000214601360121470136007EFE09D2190141", strlen(RECORD));
+    test_invalid("bad data", ":10010000214601360121470136007EFE09D2190240", strlen(RECORD));
+    test_invalid("bad end of file", ":00000001FE", 11);
+
+    // Anything but a hex digit inside a record, it stops on the character
+    test_invalid("letter", ":10010000214601360121470136007EFE09G2190140", 36);
+    test_invalid("space", ":1001 0000214601360121470136007EFE09D2190140", 6);
+    test_invalid("line break", ":100100002146013601\r\n21470136007EFE09D2190140", 20);
+    test_invalid("start code only", ":\n", 2);
+
+    // A start code part way through a record starts it over
+    snprintf(line, sizeof(line), ":1001000021460136%s", RECORD);
+    test_chunks("restarted", line, 16, 0x0100, HEX_Data, RECORD_DATA);
+
+    // A record cut short and reset is dropped, what is left of it is skipped
+    hex_parse_reset();
+    CHECK(hex_parse(RECORD, 20, &used) == HEX_Pending, "first half");
+    hex_parse_reset();
+    CHECK(hex_parse(RECORD + 20, strlen(RECORD) - 20, &used) == HEX_Pending, "second half after a reset");
+
+    printf("hex_parse_test: %d failed\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+"""Write blocks encoded by lz.py, with what lz_decode has to make of them, for lz_test to check lz.c against
+
+Every case is a stream, decoded from lz_init on, of blocks each with the limit it is decoded with and what
+lz_decode has to return, then the data the sink has to have been handed.
+
+Record layout (little-endian):
+    'S'                                              start a stream
+    'B' | length u32 | limit u32 | expect i32 | block  decode a block, expect is -1 if it has to be rejected
+    'O' | length u32 | data                          everything the sink was handed since the stream started
+
+    python lz_cases.py out.lzc
+"""
+import argparse
+import os
+import random
+import struct
+import sys
+from typing import List, Tuple
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..'))
+
+from lz import LZ_MIN_MATCH, Encoder, _sequence  # noqa: E402
+
+# NOTE: These values should agree with include/frame.h
+FRAME_INFLATED_MAX = 32768
+FRAME_PAYLOAD_MAX = 4096
+
+
+def encode(data: bytes, inflated: int = FRAME_INFLATED_MAX, payload: int = FRAME_PAYLOAD_MAX) -> List[Tuple[bytes, int]]:
+    """Blocks of data the way frame_usb.py sends them, (block, bytes it decodes to)"""
+    encoder = Encoder(data)
+    blocks = []
+    while encoder.pos < len(data):
+        blocks.append(encoder.block(min(len(data), encoder.pos + inflated), payload))
+    return blocks
+
+
+class Cases:
+    def __init__(self):
+        self.out = bytearray()
+        self.count = 0
+
+    def stream(self, blocks: List[Tuple[bytes, int, int]], data: bytes) -> None:
+        """Blocks as (block, limit, expect), then the data they have to leave"""
+        self.out += b'S'
+        for block, limit, expect in blocks:
+            self.out += b'B' + struct.pack('<IIi', len(block), limit, expect) + block
+        self.out += b'O' + struct.pack('<I', len(data)) + data
+        self.count += 1
+
+    def round_trip(self, data: bytes, **kwargs) -> None:
+        """Every block decodes with the limit frame_usb.py gives it, its extent"""
+        blocks = encode(data, **kwargs)
+        self.stream([(block, n, n) for block, n in blocks], data)
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('out')
+    args = parser.parse_args()
+
+    rng = random.Random(2024)
+    cases = Cases()
+
+    # Literal only, random bytes have no match to find, in a block of its own and over several
+    noise = bytes(rng.getrandbits(8) for _ in range(20000))
+    blocks = encode(noise[:3000])
+    assert all(block[0] & 0x0F == 0 and len(block) > 3000 for block, _ in blocks), "noise should not compress"
+    cases.round_trip(noise[:3000])
+    cases.round_trip(noise, inflated=6000)
+
+    # Literal lengths right at the extension boundaries
+    for n in (1, 14, 15, 16, 269, 270, 271, 600):
+        cases.stream([(_sequence(noise[:n]), n, n)], noise[:n])
+
+    # Overlapping matches, each copies bytes it has only just produced
+    cases.round_trip(b'a' * 5000)                                  # offset 1
+    cases.round_trip(b'ab' * 3000)                                 # offset 2
+    cases.round_trip(b'xyz' + b'0123456789' * 700)                 # offset 10, longer than the window
+    run = _sequence(b'q', 1, 300)                                  # a 300 byte match from a single literal
+    cases.stream([(run, 301, 301)], b'q' * 301)
+
+    # Matches reaching back into earlier blocks, and the window wrapping many times
+    program = bytearray()
+    while len(program) < 120000:
+        program += bytes(rng.getrandbits(8) for _ in range(rng.randint(1, 40)))
+        back = rng.randint(1, min(len(program), 4096))
+        program += program[-back:][:rng.randint(LZ_MIN_MATCH, 200)]
+    program = bytes(program[:120000])
+    cases.round_trip(program)
+    cases.round_trip(program, inflated=777, payload=300)
+
+    # A block that ends exactly at its limit is whole, one byte less and it has to be rejected
+    block, n = encode(program[:5000])[0]
+    cases.stream([(block, n, n)], program[:n])
+    cases.stream([(block, n - 1, -1)], b'')
+    literal = _sequence(noise[:100])
+    cases.stream([(literal, 99, -1)], b'')
+    cases.stream([(run, 300, -1)], b'')
+
+    # Truncated blocks have to be rejected, short of literals, inside an offset or inside a length extension
+    cases.stream([(literal[:-1], 100, -1)], b'')
+    cases.stream([(_sequence(noise[:300])[:20], 300, -1)], b'')
+    seq = _sequence(b'abcd', 4, 8)
+    cases.stream([(seq[:6], 12, -1)], b'')
+    long_match = _sequence(b'abcd', 4, 400)
+    cases.stream([(long_match[:-1], 404, -1)], b'')
+    lit_ext = _sequence(noise[:300])
+    cases.stream([(lit_ext[:1], 300, -1)], b'')
+
+    # Offsets of 0, before the start of the stream or beyond the window are rejected
+    cases.stream([(_sequence(b'abcd', 0, 4), 8, -1)], b'')
+    cases.stream([(_sequence(b'abcd', 5, 4), 8, -1)], b'')
+    big = noise[:5000]
+    cases.stream([(_sequence(big[:4100]), 4100, 4100), (_sequence(b'', 4097, 4), 4, -1)], big[:4100])
+
+    with open(args.out, 'wb') as file:
+        file.write(cases.out)
+    print(f"lz_cases: {cases.count} streams")
+
+
+if __name__ == "__main__":
+    main()
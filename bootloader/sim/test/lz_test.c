@@ -0,0 +1,137 @@
+/**
+ * @file lz_test.c
+ * @author IR
+ * @brief Checks the bootloader's LZ decoder against blocks encoded by lz.py
+ * @details Reads the streams lz_cases.py writes, decodes each of their blocks with the limit given and checks what
+ * lz_decode returns and, once a stream is done, everything its sink was handed.
+ *
+ *     python lz_cases.py cases.lzc && lz_test cases.lzc
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+
+static lz_stream_t lz;
+
+static uint8_t *sunk; // Everything the sink was handed since the stream started
+static uint32_t sunk_len, sunk_max;
+static uint32_t sunk_largest; // Most handed over at once
+
+static void sink(const uint8_t *data, uint32_t len) {
+    if (sunk_len + len > sunk_max) {
+        sunk_max = (sunk_len + len) * 2;
+        sunk = realloc(sunk, sunk_max);
+    }
+    memcpy(sunk + sunk_len, data, len);
+    sunk_len += len;
+    if (len > sunk_largest)
+        sunk_largest = len;
+}
+
+static const uint8_t *cases, *cases_end;
+
+static uint32_t take_u32(void) {
+    if (cases_end - cases < 4) {
+        fprintf(stderr, "lz_test: case file ends inside a record\n");
+        exit(2);
+    }
+    uint32_t v = cases[0] | (cases[1] << 8) | (cases[2] << 16) | ((uint32_t)cases[3] << 24);
+    cases += 4;
+    return v;
+}
+
+static const uint8_t *take(uint32_t len) {
+    if ((uint32_t)(cases_end - cases) < len) {
+        fprintf(stderr, "lz_test: case file ends inside a record\n");
+        exit(2);
+    }
+    const uint8_t *p = cases;
+    cases += len;
+    return p;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s CASES\n", argv[0]);
+        return 2;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        perror(argv[1]);
+        return 2;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *file = malloc(size);
+    if ((file == NULL) || (fread(file, 1, size, f) != (size_t)size)) {
+        perror(argv[1]);
+        return 2;
+    }
+    fclose(f);
+    cases = file;
+    cases_end = file + size;
+
+    uint32_t streams = 0, blocks = 0, failed = 0, stream_blocks = 0, stream_rejects = 0;
+
+    while (cases < cases_end) {
+        uint8_t record = *cases++;
+
+        if (record == 'S') {
+            lz_init(&lz, sink);
+            sunk_len = sunk_largest = 0;
+            stream_blocks = stream_rejects = 0;
+            streams++;
+        } else if (record == 'B') {
+            uint32_t len = take_u32();
+            uint32_t limit = take_u32();
+            int32_t expect = (int32_t)take_u32();
+            const uint8_t *block = take(len);
+
+            // Decoded from a copy of its own, so reading past the end of the block would be caught by a sanitizer
+            uint8_t *copy = malloc(len ? len : 1);
+            memcpy(copy, block, len);
+            int32_t got = lz_decode(&lz, copy, len, limit);
+            free(copy);
+
+            if (got != expect) {
+                fprintf(stderr, "lz_test: stream %u block %u of %u bytes, limit %u, decoded to %d, expected %d\n",
+                        streams, stream_blocks, len, limit, got, expect);
+                failed++;
+            }
+            stream_rejects += expect < 0;
+            stream_blocks++;
+            blocks++;
+        } else if (record == 'O') {
+            uint32_t len = take_u32();
+            const uint8_t *data = take(len);
+
+            // A rejected block may have handed over what it decoded before it was found malformed, then only what the
+            // blocks before it decoded to has to be there
+            if ((stream_rejects ? sunk_len < len : sunk_len != len) || (len && (memcmp(sunk, data, len) != 0))) {
+                fprintf(stderr, "lz_test: stream %u handed %u bytes to the sink, not the %u expected\n", streams, sunk_len, len);
+                failed++;
+            } else if (sunk_largest > LZ_FLUSH) {
+                fprintf(stderr, "lz_test: stream %u handed %u bytes to the sink at once\n", streams, sunk_largest);
+                failed++;
+            }
+        } else {
+            fprintf(stderr, "lz_test: unknown record '%c'\n", record);
+            return 2;
+        }
+    }
+
+    printf("lz_test: %u streams, %u blocks, %u failed\n", streams, blocks, failed);
+    free(file);
+    free(sunk);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+"""Generate a program the way the build links it, for the bootloader simulation's tests and benchmark
+
+The program is deterministic filler that compresses about as well as real code. It is written as an ELF file
+with a stand-in bootloader in .boot3, a .flash_header placeholder and the program itself, the same layout as
+PMPi.elf. imgtool turns it into PMPi_OUT.hex and PMPi_OUT.bin the same as it does for the real program.
+The last run of the program is placed the way .data is, run from RAM but stored in flash.
+
+    python make_image.py out.elf [--size BYTES] [--seed N] [--gap OFFSET:LENGTH ...]
+"""
+import argparse
+import random
+import struct
+from typing import List, Tuple
+
+FLASH_BOOTLOADER_ORIGIN = 0x10000000
+FLASH_HEADER_ORIGIN = 0x10009000
+FLASH_MAIN_ORIGIN = 0x1000A000
+FLASH_HEADER_LENGTH = 4096
+BOOTLOADER_LENGTH = 12 * 1024
+RAM_ORIGIN = 0x20000000
+
+# What the linker script puts in .flash_header before imgtool fills it in
+HEADER_PLACEHOLDER = struct.pack('<4I', 0xDEADBEEF, 0xDEADBEEF, 0xDEADBEEF, 0xEFBEADDE)
+
+ELF_HEADER = struct.Struct('<16sHHIIIIIHHHHHH')
+PROGRAM_HEADER = struct.Struct('<8I')
+SECTION_HEADER = struct.Struct('<10I')
+
+EM_ARM = 40
+PT_LOAD = 1
+SHT_PROGBITS = 1
+SHT_STRTAB = 3
+SHF_ALLOC = 0x2
+SHF_EXECINSTR = 0x4
+
+
+def program(size: int, seed: int) -> bytes:
+    """Runs of fresh bytes mixed with repeats of earlier ones, roughly how code and constant data look"""
+    rng = random.Random(seed)
+    out = bytearray()
+    while len(out) < size:
+        if out and rng.random() < 0.6:
+            start = rng.randrange(max(0, len(out) - 4096), len(out))
+            length = rng.randrange(4, 64)
+            out += bytes(out[start + (i % (len(out) - start))] for i in range(length))
+        else:
+            out += bytes(rng.randrange(256) for _ in range(rng.randrange(1, 32)))
+    return bytes(out[:size])
+
+
+def runs(data: bytes, skip: List[Tuple[int, int]]) -> List[Tuple[int, bytes]]:
+    """(offset, data) of each run of data between the skipped (offset, length) ranges"""
+    out = []
+    offset = 0
+    for gap_offset, gap_length in sorted(skip) + [(len(data), 0)]:
+        if gap_offset > offset:
+            out.append((offset, data[offset:gap_offset]))
+        offset = max(offset, gap_offset + gap_length)
+    return out
+
+
+def write_elf(path: str, sections: List[Tuple[str, int, int, int, bytes]], entry: int) -> None:
+    """Write a 32 bit ARM ELF file with a loadable segment for each (name, address, load address, flags, data)"""
+    names = b'\0' + b''.join(name.encode() + b'\0' for name, *_ in sections) + b'.shstrtab\0'
+    phoff = ELF_HEADER.size
+    offset = phoff + PROGRAM_HEADER.size * len(sections)
+
+    contents = bytearray()
+    program_headers = bytearray()
+    section_headers = bytearray(SECTION_HEADER.size)
+    name_offset = 1
+    for name, address, load, flags, data in sections:
+        at = offset + len(contents)
+        contents += data
+        program_headers += PROGRAM_HEADER.pack(PT_LOAD, at, address, load, len(data), len(data), 5 if flags & SHF_EXECINSTR else 6, 4)
+        section_headers += SECTION_HEADER.pack(name_offset, SHT_PROGBITS, SHF_ALLOC | flags, address, at, len(data), 0, 0, 4, 0)
+        name_offset += len(name) + 1
+
+    strtab_at = offset + len(contents)
+    contents += names
+    section_headers += SECTION_HEADER.pack(name_offset, SHT_STRTAB, 0, 0, strtab_at, len(names), 0, 0, 1, 0)
+    shoff = offset + len(contents)
+
+    ident = b'\x7fELF' + bytes([1, 1, 1]) + bytes(9)
+    header = ELF_HEADER.pack(ident, 2, EM_ARM, 1, entry, phoff, shoff, 0x05000200, ELF_HEADER.size,
+                             PROGRAM_HEADER.size, len(sections), SECTION_HEADER.size, len(sections) + 2, len(sections) + 1)
+
+    with open(path, 'wb') as file:
+        file.write(header + program_headers + contents + section_headers)
+
+
+def parse_gap(text: str) -> Tuple[int, int]:
+    offset, length = text.split(':')
+    return int(offset, 0), int(length, 0)
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('ofile', help="Output ELF file")
+    parser.add_argument('--size', type=lambda x: int(x, 0), default=256 * 1024, help="Program size in bytes")
+    parser.add_argument('--seed', type=int, default=1, help="Seed for the program's content")
+    parser.add_argument('--gap', type=parse_gap, action='append', default=[], help="OFFSET:LENGTH of the program to leave out")
+    args = parser.parse_args()
+
+    app = program(args.size, args.seed)
+    bootloader = program(BOOTLOADER_LENGTH, args.seed + 1)
+    header = HEADER_PLACEHOLDER + b'\xff' * (FLASH_HEADER_LENGTH - len(HEADER_PLACEHOLDER))
+
+    sections = [('.boot3', FLASH_BOOTLOADER_ORIGIN, FLASH_BOOTLOADER_ORIGIN, SHF_EXECINSTR, bootloader),
+                ('.flash_header', FLASH_HEADER_ORIGIN, FLASH_HEADER_ORIGIN, 0, header)]
+    app_runs = runs(app, args.gap)
+    for i, (offset, data) in enumerate(app_runs):
+        load = FLASH_MAIN_ORIGIN + offset
+        if i == len(app_runs) - 1 and i > 0:
+            sections.append(('.data', RAM_ORIGIN, load, 0, data))
+        else:
+            sections.append((f'.text.{i}', load, load, SHF_EXECINSTR, data))
+
+    write_elf(args.ofile, sections, FLASH_MAIN_ORIGIN | 1)
+
+
+if __name__ == "__main__":
+    main()
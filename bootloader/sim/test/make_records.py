@@ -0,0 +1,54 @@
+"""Write the records bin_usb.py sends for an _OUT.bin, for the simulation to read as if they were sent to it
+
+The records are written here rather than with bin_usb.py, which needs pyserial.
+
+    python make_records.py image_OUT.bin out.rec
+    python make_records.py image_OUT.bin cut.rec --stop 20        the first 20 records, as if the link went down
+    python make_records.py image_OUT.bin rest.rec --resume 19     the header, then on from the 19th program sector
+    python make_records.py image_OUT.bin stray.rec --stray 0xFFFFF000     a sector of data outside of flash first
+"""
+import argparse
+import binascii
+import struct
+
+FLASH_BOOTLOADER_ORIGIN = 0x10000000
+FLASH_HEADER_ORIGIN = 0x10009000
+FLASH_MAIN_ORIGIN = 0x1000A000
+SECTOR_SIZE = 4096
+BIN_MAGIC = 0x4E424D50
+BIN_PAYLOAD_MAX = 4096
+
+
+def record(address: int, payload: bytes) -> bytes:
+    """A single record, an empty payload ends the image"""
+    body = struct.pack('<IH', address, len(payload)) + payload
+    return struct.pack('<II', BIN_MAGIC, binascii.crc32(body)) + body
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('image')
+    parser.add_argument('out')
+    parser.add_argument('--stop', type=int, help="Only write this many records, the image is not ended")
+    parser.add_argument('--resume', type=int, default=0, help="Leave out this many sectors from the start of the program")
+    parser.add_argument('--stray', type=lambda s: int(s, 0), help="Send a sector of data at this address before anything else")
+    args = parser.parse_args()
+
+    with open(args.image, 'rb') as file:
+        image = file.read()
+
+    # Everything from the flash header on, the bootloader itself is not sent
+    start = FLASH_HEADER_ORIGIN - FLASH_BOOTLOADER_ORIGIN
+    kept = FLASH_MAIN_ORIGIN + args.resume * SECTOR_SIZE
+    recs = [record(FLASH_BOOTLOADER_ORIGIN + offset, image[offset:offset + BIN_PAYLOAD_MAX]) for offset in range(start, len(image), BIN_PAYLOAD_MAX)
+            if not FLASH_MAIN_ORIGIN <= FLASH_BOOTLOADER_ORIGIN + offset < kept]
+    recs.append(record(0, b''))
+    if args.stray is not None:
+        recs.insert(0, record(args.stray, bytes(SECTOR_SIZE)))
+
+    with open(args.out, 'wb') as file:
+        file.write(b''.join(recs[:args.stop]))
+
+
+if __name__ == "__main__":
+    main()
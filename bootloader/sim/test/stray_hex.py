@@ -0,0 +1,42 @@
+"""Copy an _OUT.hex with data records that lie outside of flash slipped in before its end of file record
+
+The bootloader has to drop them and still load the image, without writing anything of them anywhere.
+
+    python stray_hex.py image_OUT.hex stray.hex
+"""
+import argparse
+
+# Extended linear address and data record pairs, just past the end of flash and at the top of the address space
+STRAY = [
+    (0x1020, 0x0000),
+    (0x1020, 0x1000),
+    (0xFFFF, 0xF000),
+]
+
+
+def hex_record(address: int, rtype: int, data: bytes) -> str:
+    body = bytes([len(data), address >> 8, address & 0xFF, rtype]) + data
+    return ':' + (body + bytes([-sum(body) & 0xFF])).hex().upper() + '\n'
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('image')
+    parser.add_argument('out')
+    args = parser.parse_args()
+
+    with open(args.image, 'r', encoding='utf-8') as file:
+        lines = file.readlines()
+
+    stray = []
+    for upper, address in STRAY:
+        stray.append(hex_record(0, 0x04, upper.to_bytes(2, 'big')))
+        stray.append(hex_record(address, 0x00, bytes(range(16))))
+
+    end = next(i for i, line in enumerate(lines) if line.startswith(':00000001'))
+    with open(args.out, 'w', encoding='utf-8', newline='\n') as file:
+        file.writelines(lines[:end] + stray + lines[end:])
+
+
+if __name__ == "__main__":
+    main()
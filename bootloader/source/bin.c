@@ -0,0 +1,159 @@
+/**
+ * @file bin.c
+ * @author IR
+ * @brief Source file for the raw binary input scheme
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "bin.h"
+
+#include <pico/stdlib.h>
+
+#include "bootloader_config.h"
+
+#if defined(BOOT_INPUT_BIN_STREAM)
+
+    #include <string.h>
+
+    #include "dma_util.h"
+    #include "flash.h"
+    #include "led.h"
+    #include "transport.h"
+
+/**
+ * @brief A record exactly as it was received, payload straight after the header
+ */
+static struct {
+    bin_header_t header;
+    uint8_t payload[BIN_PAYLOAD_MAX];
+} record;
+
+static uint32_t next_address; // Address following the last written record
+static uint32_t last_address; // Address of the last written record
+static uint16_t last_length;  // Length of the last written record
+
+static void bin_reply(BinReply reply) {
+    transport_putchar(reply);
+    transport_flush();
+}
+
+/**
+ * @brief Prompt for a record and receive it
+ *
+ * @retval true A complete record with a valid CRC is held in record
+ * @retval false The record was truncated or corrupt
+ */
+static bool bin_receive(void) {
+    uint32_t sync = 0;
+
+    bin_reply(BIN_Ready);
+
+    // Hunt for the start of a record, skipping whatever is left of a bad one
+    while (sync != BIN_MAGIC) {
+        sync = (sync >> 8) | ((uint32_t)(uint8_t)transport_getchar_serviced(0) << 24);
+    }
+    record.header.magic = sync;
+
+    uint8_t *raw = (uint8_t *)&record.header;
+    if (!transport_read_serviced(raw + sizeof(sync), sizeof(bin_header_t) - sizeof(sync), BIN_BYTE_TIMEOUT_US))
+        return false;
+
+    if (record.header.length > BIN_PAYLOAD_MAX)
+        return false;
+
+    if (!transport_read_serviced(record.payload, record.header.length, BIN_BYTE_TIMEOUT_US))
+        return false;
+
+    const uint8_t *covered = (const uint8_t *)&record.header.address;
+    return record.header.crc == dma_crc32(covered, (record.payload + record.header.length) - covered);
+}
+
+/**
+ * @brief Write a received record to flash
+ *
+ * @retval true Record was handed over to be written
+ * @retval false Record is out of range or jumps back to the middle of a sector
+ */
+static bool bin_write(void) {
+    uint32_t address = record.header.address;
+    uint16_t length = record.header.length;
+
+    if (!flash_in_range(address, length))
+        return false;
+
+    if (address != next_address) {
+        // Jumping back into a sector would erase what it already holds
+        if ((address < next_address) && (address % SECTOR_SIZE))
+            return false;
+        flash_new_address(address);
+    }
+
+    flash_intake(address & 0xFFFF, record.payload, length);
+    next_address = address + length;
+    last_address = address;
+    last_length = length;
+    return true;
+}
+
+void bin_init(void) {
+    transport_init();
+    next_address = last_address = 0;
+    last_length = 0;
+}
+
+void bin_deinit(void) {
+    transport_puts("Branching\n");
+    transport_deinit();
+}
+
+bool bin_load(void) {
+    while (true) {
+        // The host sends the same record again on the next prompt
+        if (!bin_receive()) {
+            led_fault();
+            continue;
+        }
+
+        if (record.header.address == BIN_RESUME_ADDRESS) {
+            uint32_t program[2];
+            uint32_t point;
+
+            if (record.header.length != sizeof(program)) {
+                bin_reply(BIN_Fail);
+                return false;
+            }
+            memcpy(program, record.payload, sizeof(program));
+            point = flash_resume_point(program[0], program[1]);
+            transport_putchar(BIN_Ack);
+            transport_write(&point, sizeof(point));
+            transport_flush();
+            continue;
+        }
+
+        if (record.header.length == 0) {
+            bool committed = flash_finalize();
+            bin_reply(committed ? BIN_Ack : BIN_Fail);
+            return committed;
+        }
+
+        // The host sends a record again when it missed the ACK, it has already been written
+        if ((record.header.address == last_address) && (record.header.length == last_length)) {
+            bin_reply(BIN_Ack);
+            continue;
+        }
+
+        if (!bin_write()) {
+            bin_reply(BIN_Fail);
+            return false;
+        }
+        bin_reply(BIN_Ack);
+    }
+}
+
+#elif defined(BOOT_INPUT_BIN_SPI_FLASH)
+    #error "SPI Flash input for bin files not defined"
+#endif
@@ -0,0 +1,248 @@
+/**
+ * @file boot_api.c
+ * @author IR
+ * @brief Source file for the service table the bootloader exports to the app
+ * @details Everything the table points at runs from the RAM the bootloader copies it into. Once the app runs, the
+ * bootloader's RAM is the app's and its flash cannot be read while flash is busy, so the routines here only call
+ * each other, inline functions and the ROM, and build their constants in code. This rules out dma_util.c, which
+ * keeps state in RAM, so the DMA sniffer is driven through its registers here. What dma_util.c works out about the
+ * sniffer is copied into the table's own RAM by boot_api_install instead.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "boot_api.h"
+
+#include <hardware/dma.h>
+#include <hardware/sync.h>
+#include <pico/bootrom.h>
+#include <string.h>
+
+#include "bootloader_config.h"
+#include "dma_util.h"
+
+_Static_assert((BOOT_API_SECTOR_SIZE == SECTOR_SIZE) && (BOOT_API_PAGE_SIZE == PAGE_SIZE), "boot_api.h granularity does not match the flash");
+
+// Placed in the .boot_api_text region of RAM by the linker, loaded from flash by boot_api_install
+#define __boot_api_func(func_name) __attribute__((section(".boot_api_text." #func_name))) func_name
+
+#define BOOT_API_BLOCK_SIZE (64 * 1024)
+#define BOOT_API_BLOCK_ERASE_CMD 0xD8
+
+extern uint8_t __boot_api_text_start__[];
+extern uint8_t __boot_api_text_end__[];
+extern const uint8_t __boot_api_text_source__[];
+
+// Copy of boot2, called to bring XIP back up once flash has been written
+static uint32_t boot_api_boot2[64] __attribute__((section(".boot_api_bss")));
+
+// Which way round the sniffer takes the bytes of a word, see dma_crc32_word_bswap
+static bool boot_api_word_bswap __attribute__((section(".boot_api_bss")));
+
+// Take flash out of XIP for one erase, or one program when there is data, then bring XIP back up
+static void __boot_api_func(boot_api_flash_op)(uint32_t flash_offs, const uint8_t *data, uint32_t count) {
+    rom_connect_internal_flash_fn connect_internal_flash = (rom_connect_internal_flash_fn)rom_func_lookup_inline(ROM_FUNC_CONNECT_INTERNAL_FLASH);
+    rom_flash_exit_xip_fn flash_exit_xip = (rom_flash_exit_xip_fn)rom_func_lookup_inline(ROM_FUNC_FLASH_EXIT_XIP);
+    rom_flash_range_erase_fn flash_range_erase = (rom_flash_range_erase_fn)rom_func_lookup_inline(ROM_FUNC_FLASH_RANGE_ERASE);
+    rom_flash_range_program_fn flash_range_program = (rom_flash_range_program_fn)rom_func_lookup_inline(ROM_FUNC_FLASH_RANGE_PROGRAM);
+    rom_flash_flush_cache_fn flash_flush_cache = (rom_flash_flush_cache_fn)rom_func_lookup_inline(ROM_FUNC_FLASH_FLUSH_CACHE);
+    uint32_t ints = save_and_disable_interrupts();
+
+    __compiler_memory_barrier();
+    connect_internal_flash();
+    flash_exit_xip();
+    if (data)
+        flash_range_program(flash_offs, data, count);
+    else
+        flash_range_erase(flash_offs, count, BOOT_API_BLOCK_SIZE, BOOT_API_BLOCK_ERASE_CMD);
+    flash_flush_cache();
+    ((void (*)(void))((uintptr_t)boot_api_boot2 + 1))();
+
+    restore_interrupts(ints);
+}
+
+// Whether [flash_offs, flash_offs + count) is aligned and within the flash header and program, the bootloader is never written
+static __force_inline bool boot_api_in_program(uint32_t flash_offs, uint32_t count, uint32_t align) {
+    uint32_t start = FLASH_HEADER_ORIGIN - XIP_BASE;
+    uint32_t end = FLASH_MAIN_ORIGIN + FLASH_MAIN_LENGTH - XIP_BASE;
+
+    return !(flash_offs & (align - 1)) && !(count & (align - 1)) && (flash_offs >= start) && (flash_offs <= end) && (count <= (end - flash_offs));
+}
+
+// Whether a range reads back erased, past the XIP cache
+static __force_inline bool boot_api_erased(uint32_t flash_offs, uint32_t count) {
+    const volatile uint32_t *flash = (const volatile uint32_t *)(XIP_NOCACHE_NOALLOC_BASE + flash_offs);
+
+    for (uint32_t i = 0; i < count / sizeof(uint32_t); i++) {
+        if (flash[i] != 0xFFFFFFFFu)
+            return false;
+    }
+
+    return true;
+}
+
+// Whether a page reads back as data, past the XIP cache. The data may not be word aligned.
+static __force_inline bool boot_api_programmed(uint32_t flash_offs, const uint8_t *data) {
+    const volatile uint32_t *flash = (const volatile uint32_t *)(XIP_NOCACHE_NOALLOC_BASE + flash_offs);
+
+    for (uint32_t i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++, data += sizeof(uint32_t)) {
+        if (flash[i] != (data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24)))
+            return false;
+    }
+
+    return true;
+}
+
+// One 64K block where the range is aligned to it, a sector otherwise, so interrupts are taken in between
+static bool __boot_api_func(boot_api_flash_erase)(uint32_t flash_offs, uint32_t count) {
+    if (!boot_api_in_program(flash_offs, count, SECTOR_SIZE))
+        return false;
+
+    while (count) {
+        uint32_t step = (!(flash_offs & (BOOT_API_BLOCK_SIZE - 1)) && (count >= BOOT_API_BLOCK_SIZE)) ? BOOT_API_BLOCK_SIZE : SECTOR_SIZE;
+        bool erased = false;
+
+        for (int attempt = 0; (attempt < 2) && !erased; attempt++) {
+            boot_api_flash_op(flash_offs, NULL, step);
+            erased = boot_api_erased(flash_offs, step);
+        }
+        if (!erased)
+            return false;
+
+        flash_offs += step;
+        count -= step;
+    }
+
+    return true;
+}
+
+// The same rule flash_program_page follows, a page that did not take is programmed over itself once more
+static bool __boot_api_func(boot_api_flash_program)(uint32_t flash_offs, const void *data, uint32_t count) {
+    const uint8_t *src = data;
+
+    if (!boot_api_in_program(flash_offs, count, PAGE_SIZE))
+        return false;
+
+    for (; count; count -= PAGE_SIZE, flash_offs += PAGE_SIZE, src += PAGE_SIZE) {
+        bool programmed = false;
+
+        for (int attempt = 0; (attempt < 2) && !programmed; attempt++) {
+            boot_api_flash_op(flash_offs, src, PAGE_SIZE);
+            programmed = boot_api_programmed(flash_offs, src);
+        }
+        if (!programmed)
+            return false;
+    }
+
+    return true;
+}
+
+// Push `count` transfers through the sniffer, the accumulator carries on from the previous run
+static __force_inline void boot_api_crc32_run(uint32_t channel, const volatile void *src, uint32_t count, enum dma_channel_transfer_size size, bool bswap) {
+    volatile uint32_t sink;
+
+    if (count == 0)
+        return;
+
+    hw_write_masked(&dma_hw->sniff_ctrl, bswap ? DMA_SNIFF_CTRL_BSWAP_BITS : 0, DMA_SNIFF_CTRL_BSWAP_BITS);
+    dma_hw->ch[channel].read_addr = (uintptr_t)src;
+    dma_hw->ch[channel].write_addr = (uintptr_t)&sink;
+    dma_hw->ch[channel].transfer_count = count;
+    dma_hw->ch[channel].ctrl_trig = DMA_CH0_CTRL_TRIG_EN_BITS | (size << DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB) | DMA_CH0_CTRL_TRIG_INCR_READ_BITS |
+                                    (channel << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB) | DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS | DMA_CH0_CTRL_TRIG_SNIFF_EN_BITS;
+    while (dma_hw->ch[channel].ctrl_trig & DMA_CH0_CTRL_TRIG_BUSY_BITS) {
+    }
+}
+
+// See dma_crc32_span in dma_util.c
+static uint32_t __boot_api_func(boot_api_crc32_span)(uint32_t channel, const volatile uint8_t *src, uint32_t len, bool word_bswap) {
+    dma_hw->sniff_data = 0xFFFFFFFFu;
+    dma_hw->sniff_ctrl = (channel << DMA_SNIFF_CTRL_DMACH_LSB) | (0x1 << DMA_SNIFF_CTRL_CALC_LSB) | DMA_SNIFF_CTRL_EN_BITS | DMA_SNIFF_CTRL_OUT_INV_BITS | DMA_SNIFF_CTRL_OUT_REV_BITS;
+
+    uint32_t head = (4 - ((uintptr_t)src & 3)) & 3;
+    if (head > len)
+        head = len;
+    uint32_t words = (len - head) / 4;
+
+    boot_api_crc32_run(channel, src, head, DMA_SIZE_8, true);
+    boot_api_crc32_run(channel, src + head, words, DMA_SIZE_32, word_bswap);
+    boot_api_crc32_run(channel, src + head + (words * 4), len - head - (words * 4), DMA_SIZE_8, true);
+
+    return dma_hw->sniff_data;
+}
+
+static uint32_t __boot_api_func(boot_api_crc32)(uint32_t channel, const void *src, uint32_t len) {
+    uint32_t crc = boot_api_crc32_span(channel, src, len, boot_api_word_bswap);
+    dma_hw->sniff_ctrl = 0;
+
+    return crc;
+}
+
+#define boot_api_header_word(offset) (*((const volatile uint32_t *)(FLASH_HEADER_ORIGIN + (offset))))
+
+// Whether the flash header carries a sector table that agrees with the size of the program, see check_flash_header in bootloader.c
+static __force_inline bool boot_api_header_has_table(void) {
+    uint32_t size = boot_api_header_word(FLASH_HEADER_CRC_SZ_OFFSET);
+    uint32_t sectors = boot_api_header_word(FLASH_HEADER_SECTORS_OFFSET);
+
+    return (boot_api_header_word(FLASH_HEADER_VERSION_OFFSET) == FLASH_HEADER_VERSION) && (size <= FLASH_MAIN_LENGTH) && (sectors == ((size + SECTOR_SIZE - 1) / SECTOR_SIZE));
+}
+
+// CRC32 of a sector of the program, the last one only covers what is left of it
+static __force_inline bool boot_api_sector_matches(uint32_t channel, uint32_t sector, uint32_t base) {
+    uint32_t size = boot_api_header_word(FLASH_HEADER_CRC_SZ_OFFSET);
+    uint32_t offset = sector * SECTOR_SIZE;
+    uint32_t len = ((size - offset) < SECTOR_SIZE) ? (size - offset) : SECTOR_SIZE;
+
+    return boot_api_header_word(FLASH_HEADER_TABLE_OFFSET + (sector * sizeof(uint32_t))) == boot_api_crc32(channel, (const void *)(base + offset), len);
+}
+
+// See check_flash_sectors and check_flash_crc32 in bootloader.c
+static int32_t __boot_api_func(boot_api_image_check)(uint32_t channel, uint32_t sector) {
+    uint32_t size = boot_api_header_word(FLASH_HEADER_CRC_SZ_OFFSET);
+    uint32_t sectors = boot_api_header_word(FLASH_HEADER_SECTORS_OFFSET);
+
+    if (size > FLASH_MAIN_LENGTH)
+        return 0;
+
+    if (!boot_api_header_has_table())
+        return (boot_api_crc32(channel, (const void *)FLASH_MAIN_ORIGIN, size) == boot_api_header_word(FLASH_HEADER_CRC_OFFSET)) ? -1 : 0;
+
+    for (; sector < sectors; sector++) {
+        if (!boot_api_sector_matches(channel, sector, FLASH_MAIN_ORIGIN))
+            return sector;
+    }
+
+    return -1;
+}
+
+static int32_t __boot_api_func(boot_api_image_check_sector)(uint32_t channel, uint32_t sector) {
+    if (!boot_api_header_has_table() || (sector >= boot_api_header_word(FLASH_HEADER_SECTORS_OFFSET)))
+        return -1;
+
+    return boot_api_sector_matches(channel, sector, XIP_NOCACHE_NOALLOC_BASE + (FLASH_MAIN_ORIGIN - XIP_BASE));
+}
+
+const boot_api_t __boot_api __attribute__((section(".boot_api"), used)) = {
+    .magic = BOOT_API_MAGIC,
+    .version = BOOT_API_VERSION,
+    .size = sizeof(boot_api_t),
+    .flash_erase = boot_api_flash_erase,
+    .flash_program = boot_api_flash_program,
+    .crc32 = boot_api_crc32,
+    .image_check = boot_api_image_check,
+    .image_check_sector = boot_api_image_check_sector,
+};
+
+void boot_api_install(void) {
+    memcpy(__boot_api_text_start__, __boot_api_text_source__, __boot_api_text_end__ - __boot_api_text_start__);
+
+    // Always the boot2 this boot came up with, at the start of flash
+    memcpy(boot_api_boot2, (const void *)XIP_BASE, sizeof(boot_api_boot2));
+
+    // Worked out once here rather than on every call, the bootloader has most likely done so already
+    boot_api_word_bswap = dma_crc32_word_bswap();
+}
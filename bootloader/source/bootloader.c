@@ -15,7 +15,14 @@
 #include <hardware/watchdog.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
+#if defined(BOOTLOADER_HOST_SIM)
+    #include <stdlib.h>
+#endif
+
+#include "boot_api.h"
+#include "boot_info.h"
 #include "dma_util.h"
 #include "flash.h"
 #include "led.h"
@@ -24,6 +31,10 @@
     #include "hex.h"
     #define input_init hex_init
     #define input_deinit hex_deinit
+#elif defined(BOOT_INPUT_FRAME)
+    #include "frame.h"
+    #define input_init frame_init
+    #define input_deinit frame_deinit
 #elif defined(BOOT_INPUT_ELF)
     #include "elf.h"
     #define input_init elf_init
@@ -34,12 +45,14 @@
     #define input_deinit bin_deinit
 #endif
 
-bool bootloader_load_program(void) {
+static bool program_missing; // The program in flash did not check out when the bootloader started
+
+// Receive and flash a program using the selected input scheme
+static bool bootloader_receive(void) {
 #if defined(BOOT_INPUT_HEX)
     uint16_t msb_addr = 0;
     bool new_addr = false;
     while (hex_load()) {
-        sleep_ms(10); // FIXME: delay is needed, otherwise pico hard crashes. Issue with flash writing speed?
         switch (HEX.type) {
             case HEX_Data:
                 if (new_addr) {
@@ -53,8 +66,9 @@ bool bootloader_load_program(void) {
                     flash_new_address(((msb_addr << 16u) | HEX.address));
                     new_addr = false;
                 }
-                flash_finalize();
-                blink(LED2_PIN, 10, 50);
+                if (!flash_finalize())
+                    return false;
+                led_set(LED_Done);
                 return true;
             case HEX_ExtendedLinearAddress:
                 msb_addr = (HEX.data[0] << 8) | HEX.data[1];
@@ -65,17 +79,56 @@ bool bootloader_load_program(void) {
                 break;
         }
     }
+#elif defined(BOOT_INPUT_FRAME)
+    if (frame_load()) {
+        led_set(LED_Done);
+        return true;
+    }
 #elif defined(BOOT_INPUT_ELF)
     #error "Protocol for loading .ELF files NOT defined"
 #elif defined(BOOT_INPUT_BIN)
-    #error "Protocol for loading .BIN files NOT defined"
+    if (bin_load()) {
+        led_set(LED_Done);
+        return true;
+    }
 #else
     #error "Valid protocol for loading a binary NOT declared"
 #endif
     return false;
 }
 
+bool bootloader_load_program(void) {
+    uint32_t start = time_us_32();
+    bool loaded = bootloader_receive();
+
+    // Whatever was verified before is gone, even if loading failed part way
+    __boot_info.generation++;
+    __boot_info.load_us = time_us_32() - start;
+    __boot_info.erase_us = flash_get_stats()->erase_us;
+    __boot_info.program_us = flash_get_stats()->program_us;
+
+    // The program was checked as it was written, there is no need to verify it again on the next warm boot
+    if (loaded) {
+        __boot_info.verified_generation = __boot_info.generation;
+        __boot_info.image_crc = *((uint32_t *)(FLASH_HEADER_ORIGIN + FLASH_HEADER_CRC_OFFSET));
+    } else {
+        led_set(LED_Error);
+    }
+    boot_info_seal();
+
+    return loaded;
+}
+
 void bootloader_exit(void) {
+    __boot_info.exit_us = time_us_32();
+    boot_info_seal();
+
+#if defined(BOOTLOADER_HOST_SIM)
+    // There is no program to branch into on the host (see sim/), the simulation ends here
+    exit(0);
+#else
+    boot_api_install();
+
     asm volatile(
         "mov r0, %[start]\n"
         "ldr r1, =%[vtable]\n"
@@ -86,6 +139,7 @@ void bootloader_exit(void) {
         :
         : [start] "r"(FLASH_MAIN_ORIGIN), [vtable] "X"(PPB_BASE + M0PLUS_VTOR_OFFSET)
         :);
+#endif
 }
 
 void bootloader_init(void) {
@@ -93,7 +147,9 @@ void bootloader_init(void) {
     flash_init();
     input_init();
 
-    blink(LED_PIN, 4, 100);
+    // Left over from a failed load or never flashed, shown until a host starts sending
+    if (program_missing)
+        led_set(LED_Error);
 }
 
 void bootloader_deinit(void) {
@@ -118,45 +174,102 @@ void bootloader_soft_reset() {
     }
 }
 
+// Whether the flash header carries a sector table that agrees with the size of the program
+static bool check_flash_header(void) {
+    uint32_t version = *((uint32_t *)(FLASH_HEADER_ORIGIN + FLASH_HEADER_VERSION_OFFSET));
+    uint32_t size = *((uint32_t *)(FLASH_HEADER_ORIGIN + FLASH_HEADER_CRC_SZ_OFFSET));
+    uint32_t sectors = *((uint32_t *)(FLASH_HEADER_ORIGIN + FLASH_HEADER_SECTORS_OFFSET));
+
+    return (version == FLASH_HEADER_VERSION) && (size <= FLASH_MAIN_LENGTH) && (sectors == ((size + SECTOR_SIZE - 1) / SECTOR_SIZE));
+}
+
+int32_t check_flash_sectors(uint32_t sector) {
+    uint32_t size = *((uint32_t *)(FLASH_HEADER_ORIGIN + FLASH_HEADER_CRC_SZ_OFFSET));
+    uint32_t sectors = *((uint32_t *)(FLASH_HEADER_ORIGIN + FLASH_HEADER_SECTORS_OFFSET));
+    uint32_t *table = (uint32_t *)(FLASH_HEADER_ORIGIN + FLASH_HEADER_TABLE_OFFSET);
+
+    if (!check_flash_header())
+        return sector;
+
+    for (; sector < sectors; sector++) {
+        uint32_t offset = sector * SECTOR_SIZE;
+        uint32_t len = ((size - offset) < SECTOR_SIZE) ? (size - offset) : SECTOR_SIZE;
+
+        if (table[sector] != dma_crc32((uint8_t *)(FLASH_MAIN_ORIGIN + offset), len))
+            return sector;
+    }
+
+    return -1;
+}
+
 bool check_flash_crc32() {
-    int dma_checksum = 0;
     uint8_t *flash = (uint8_t *)(FLASH_MAIN_ORIGIN);
     uint32_t header_crc = *((uint32_t *)(FLASH_HEADER_ORIGIN + FLASH_HEADER_CRC_OFFSET));
     uint32_t header_crc_sz = *((uint32_t *)(FLASH_HEADER_ORIGIN + FLASH_HEADER_CRC_SZ_OFFSET));
-    volatile uint8_t load_buffer;
 
     // FIXME: debug with both app and bootloader flashed
 
+    if (check_flash_header())
+        return check_flash_sectors(0) < 0;
+
     if (header_crc_sz > FLASH_MAIN_LENGTH)
         return false;
 
-    // 🙏 https://forums.raspberrypi.com/viewtopic.php?t=336582 🙏
-    dma_checksum = dma_init(&load_buffer, flash, header_crc_sz, DMA_SIZE_8, true, false);
-    // channel_config_set_bswap(&config, true); // Is this set by the sniffer?
-    dma_sniffer_enable(dma_checksum, 0x1, true);
-    dma_sniffer_set_byte_swap_enabled(true);
-    dma_sniffer_set_data_accumulator(0xffffffff);
-    hw_set_bits(&dma_hw->sniff_ctrl, (DMA_SNIFF_CTRL_OUT_INV_BITS | DMA_SNIFF_CTRL_OUT_REV_BITS));
+    return header_crc == dma_crc32(flash, header_crc_sz);
+}
+
+// Start this boot's handoff block, carrying over the image generation from the last one when it can be trusted
+static void boot_info_begin(bool warm) {
+    if (!warm || !boot_info_valid()) {
+        memset(&__boot_info, 0, sizeof(__boot_info));
+        __boot_info.magic = BOOT_INFO_MAGIC;
+        __boot_info.version = BOOT_INFO_VERSION;
+        __boot_info.size = sizeof(boot_info_t);
+        __boot_info.verified_generation = ~__boot_info.generation;
+    }
 
-    dma_channel_start(dma_checksum);
-    dma_channel_wait_for_finish_blocking(dma_checksum);
+    __boot_info.verify_us = 0;
+    __boot_info.load_us = 0;
+    __boot_info.erase_us = 0;
+    __boot_info.program_us = 0;
+    __boot_info.exit_us = 0;
+}
+
+// Verify the program unless it was verified before a warm reboot and flash has not been written since
+static bool check_flash_program(bool warm) {
+    uint32_t start = time_us_32();
+    uint32_t header_crc = *((uint32_t *)(FLASH_HEADER_ORIGIN + FLASH_HEADER_CRC_OFFSET));
 
-    uint32_t flash_crc = dma_sniffer_get_data_accumulator();
+    if (warm && (__boot_info.verified_generation == __boot_info.generation) && (__boot_info.image_crc == header_crc))
+        return true;
 
-    // Disable dma sniffer and deinit dma
-    dma_deinit(dma_checksum);
-    dma_sniffer_disable();
+    if (!check_flash_crc32())
+        return false;
 
-    return header_crc == flash_crc;
+    __boot_info.verify_us = time_us_32() - start;
+    __boot_info.verified_generation = __boot_info.generation;
+    __boot_info.image_crc = header_crc;
+    return true;
 }
 
 bool bootloader_should_run() {
-    if (watchdog_hw->scratch[0] || !check_flash_crc32()) {
+    bool warm = watchdog_caused_reboot();
+    bool requested = watchdog_hw->scratch[0];
+
+    boot_info_begin(warm);
+    __boot_info.reason = requested ? BOOT_ReasonRequested : (warm ? BOOT_ReasonWatchdog : BOOT_ReasonPowerOn);
+
+    // A requested entry does not wait on a full verify, it shows the idle LED rather than the error one
+    program_missing = !requested && !check_flash_program(warm);
+
+    if (requested || program_missing) {
         // Reset WD scratch on soft-reset into bootloader
         watchdog_hw->scratch[0] = 0;
+        boot_info_seal();
 
         return true;
     }
 
+    boot_info_seal();
     return false;
 }
@@ -33,4 +33,75 @@ int dma_init(volatile void *write_addr, const volatile void *read_addr, uint tra
 void dma_deinit(int handle) {
     dma_channel_cleanup(handle);
     dma_channel_unclaim(handle);
-}
\ No newline at end of file
+}
+
+// "12345678" and its CRC32, used to work out the sniffer's byte order for word transfers
+static const uint32_t crc_check_data[2] = {0x34333231, 0x38373635};
+#define CRC_CHECK_VALUE 0x9AE0DAAFu
+
+static bool crc_word_checked;
+static bool crc_word_bswap; // Word transfers need the sniffer byte swap to be fed in memory order
+
+// Push `count` transfers through the sniffer, the accumulator carries on from the previous run
+static void dma_crc32_run(int handle, const volatile void *src, uint count, enum dma_channel_transfer_size size, bool bswap) {
+    static volatile uint32_t sink;
+
+    if (count == 0)
+        return;
+
+    dma_channel_config config = dma_channel_get_default_config(handle);
+    channel_config_set_transfer_data_size(&config, size);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+
+    dma_sniffer_set_byte_swap_enabled(bswap);
+    dma_channel_configure(handle, &config, &sink, src, count, true);
+    dma_channel_wait_for_finish_blocking(handle);
+}
+
+static uint32_t dma_crc32_span(int handle, const volatile uint8_t *src, uint len, bool word_bswap) {
+    // 🙏 https://forums.raspberrypi.com/viewtopic.php?t=336582 🙏
+    dma_sniffer_enable(handle, 0x1, true);
+    dma_sniffer_set_data_accumulator(0xffffffff);
+    hw_set_bits(&dma_hw->sniff_ctrl, (DMA_SNIFF_CTRL_OUT_INV_BITS | DMA_SNIFF_CTRL_OUT_REV_BITS));
+
+    // Bytes up to a word boundary, then whole words, then the bytes left over
+    uint head = (4 - ((uintptr_t)src & 3)) & 3;
+    if (head > len)
+        head = len;
+    uint words = (len - head) / 4;
+
+    dma_crc32_run(handle, src, head, DMA_SIZE_8, true);
+    dma_crc32_run(handle, src + head, words, DMA_SIZE_32, word_bswap);
+    dma_crc32_run(handle, src + head + (words * 4), len - head - (words * 4), DMA_SIZE_8, true);
+
+    return dma_sniffer_get_data_accumulator();
+}
+
+bool dma_crc32_word_bswap(void) {
+    // Which way round the sniffer takes the bytes of a word is checked once against a known CRC
+    if (!crc_word_checked) {
+        int handle = dma_claim_unused_channel(true);
+
+        crc_word_checked = true;
+        crc_word_bswap = dma_crc32_span(handle, (const volatile uint8_t *)crc_check_data, sizeof(crc_check_data), false) != CRC_CHECK_VALUE;
+
+        dma_deinit(handle);
+        dma_sniffer_disable();
+    }
+
+    return crc_word_bswap;
+}
+
+uint32_t dma_crc32(const volatile void *src, uint len) {
+    bool word_bswap = dma_crc32_word_bswap();
+    int handle = dma_claim_unused_channel(true);
+
+    uint32_t crc = dma_crc32_span(handle, src, len, word_bswap);
+
+    // Disable dma sniffer and deinit dma
+    dma_deinit(handle);
+    dma_sniffer_disable();
+
+    return crc;
+}
@@ -15,192 +15,627 @@
 #include <dma_util.h>
 #include <hardware/dma.h>
 #include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <string.h>
 
+#include "bootloader.h"
 #include "bootloader_config.h"
 #include "led.h"
 
-// For keeping track of where we are in programming/erasing flash
-uint32_t programming_address = 0;
-uint32_t erasure_address = 0;
+// Sectors the program may span
+#define FLASH_MAIN_SECTORS (FLASH_MAIN_LENGTH / SECTOR_SIZE)
 
-int dma_flash_clear; // Clears flashbuffer
-// int dma_flash_copy;  // Copies flashbuffer to first_page_buffer
+// 32K block erases are not exposed by hardware/flash, these are common to the W25Q series and compatible parts
+#define FLASH_CMD_WRITE_ENABLE 0x06
+#define FLASH_CMD_READ_STATUS 0x05
+#define FLASH_CMD_BLOCK32_ERASE 0x52
+#define FLASH_STATUS_BUSY 0x01
+#define FLASH_BLOCK32_SIZE (32 * 1024)
+#define FLASH_BLOCK64_SIZE (64 * 1024)
 
-// Flash memory buffer and index
-uint8_t flashbuffer[PAGE_SIZE] = {0};
-uint8_t flashdex = 0;
+// Times a sector is erased and written again when one of its pages does not read back as written
+#define FLASH_SECTOR_RETRIES 2
 
-// We're going to program the first page LAST, so we don't
-// accidentally vector into a partially-programmed application
-// unsigned char first_page = 0;
-// unsigned char first_page_buffer[PAGE_SIZE] = {0};
+// Transfer progress is kept in the last page of the header sector, which is erased for as long as a transfer is
+// in progress. "PMJR" little-endian.
+#define FLASH_JOURNAL_MAGIC 0x524A4D50u
+#define FLASH_JOURNAL_OFFSET (SECTOR_SIZE - PAGE_SIZE)
+
+_Static_assert(FLASH_HEADER_TABLE_OFFSET + (FLASH_MAIN_SECTORS * sizeof(uint32_t)) <= FLASH_JOURNAL_OFFSET, "flash header sector table runs into the journal");
+
+/**
+ * @brief Which sectors of the program an interrupted transfer no longer needs sent
+ *
+ * @note Bits are only ever cleared, so the page is programmed over itself without being erased
+ */
+typedef struct flash_journal {
+    uint32_t magic; // Cleared once the header is committed
+    uint32_t crc;   // CRC32 and size of the program from its flash header, identify the image being transferred
+    uint32_t size;
+    uint32_t pending[(FLASH_MAIN_SECTORS + 31) / 32]; // Cleared once a sector is programmed and read back
+} flash_journal_t;
+
+/**
+ * @brief A sector worth of data, either being filled or waiting to be erased and programmed
+ */
+typedef struct flash_job {
+    bool compared;      // Sector has been compared against what is already in flash
+    bool erased;        // Sector has been erased, pages may be programmed
+    uint32_t address;   // Flash offset of the sector
+    uint16_t pages;     // Number of pages to program
+    uint16_t page;      // Next page to program
+    bool complete;      // Nothing more is coming for the sector, it is done once written
+    uint8_t retries;    // Times the sector has been erased again after a page did not read back
+    uint8_t data[SECTOR_SIZE] __attribute__((aligned(4)));
+} flash_job_t;
+
+// Double buffering, one job is filled while the other is written out
+static flash_job_t jobs[2];
+static flash_job_t *filling;    // Job receiving intake
+static flash_job_t *writing;    // Job being erased/programmed, NULL when idle
+static uint32_t fill_offset;    // Bytes of the filling job's sector covered so far, gaps included
+static uint32_t fill_end;       // End of the last intake in the filling job, nothing past it is programmed
+
+int dma_flash_clear;                      // Clears the filling job
+static const uint8_t flash_erased = 0xFF; // Gaps are left as erased flash reads
+
+// The flash header is held back and programmed last, once every sector it describes checks out
+static uint8_t header[SECTOR_SIZE] __attribute__((aligned(4)));
+static uint16_t header_pages; // Pages of header received, 0 if no header has been received
+
+// CRC32 of every sector of the program as it was handed over to be written
+static uint32_t sector_crcs[FLASH_MAIN_SECTORS];
+static uint32_t sector_written[(FLASH_MAIN_SECTORS + 31) / 32];
+
+// Sectors erased by flash_erase_range that have not been handed over yet
+static uint32_t sector_erased[(FLASH_MAIN_SECTORS + 31) / 32];
+
+// RAM copy of the journal, programmed over the one in flash whenever a sector is done
+static union {
+    flash_journal_t fields;
+    uint8_t page[PAGE_SIZE];
+} journal __attribute__((aligned(4)));
+static bool journal_open; // Whether a header was held and its transfer is being journalled
+
+static flash_stats_t stats;
 
 void flash_init() {
-    // first_page = 0;
-    programming_address = 0;
-    erasure_address = 0;
-    dma_flash_clear = dma_init(flashbuffer, &nil, PAGE_SIZE, DMA_SIZE_8, false, true);
-    // dma_flash_copy = dma_init(first_page_buffer, flashbuffer, PAGE_SIZE, DMA_SIZE_8, true, true);
+    writing = NULL;
+    filling = &jobs[0];
+    filling->address = 0;
+    fill_offset = 0;
+    fill_end = 0;
+    header_pages = 0;
+    journal_open = false;
+    memset(sector_written, 0, sizeof(sector_written));
+    memset(sector_erased, 0, sizeof(sector_erased));
+    memset(&stats, 0, sizeof(stats));
+    dma_flash_clear = dma_init(filling->data, &flash_erased, SECTOR_SIZE, DMA_SIZE_8, false, true);
+    dma_channel_start(dma_flash_clear);
+    dma_channel_wait_for_finish_blocking(dma_flash_clear);
 }
 
 void flash_deinit() {
     dma_deinit(dma_flash_clear);
-    // dma_deinit(dma_flash_copy);
 }
 
-void flash_write(uint32_t flash_offs, const uint8_t *data, size_t count) {
-    if (flash_offs >= (FLASH_HEADER_ORIGIN - XIP_BASE))
+// Interrupt handlers (USB included) execute from flash, so they must not run while flash is busy. Running from RAM
+// nothing is fetched from flash, they carry on and input keeps arriving while a sector is erased.
+static __force_inline uint32_t flash_lock(void) {
+#if defined(BOOT_RUN_FROM_RAM)
+    return 0;
+#else
+    return save_and_disable_interrupts();
+#endif
+}
+
+static __force_inline void flash_unlock(uint32_t ints) {
+#if defined(BOOT_RUN_FROM_RAM)
+    (void)ints;
+#else
+    restore_interrupts(ints);
+#endif
+}
+
+void __not_in_flash_func(flash_write)(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    if (flash_offs >= (FLASH_HEADER_ORIGIN - XIP_BASE)) {
+        uint32_t start = time_us_32();
+        uint32_t ints = flash_lock();
         flash_range_program(flash_offs, data, count);
+        flash_unlock(ints);
+        stats.program_us += time_us_32() - start;
+        stats.pages_programmed += count / PAGE_SIZE;
+    }
 }
 
-void flash_erase(uint32_t flash_offs, size_t count) {
-    if (flash_offs >= (FLASH_HEADER_ORIGIN - XIP_BASE))
+void __not_in_flash_func(flash_erase)(uint32_t flash_offs, size_t count) {
+    if (flash_offs >= (FLASH_HEADER_ORIGIN - XIP_BASE)) {
+        uint32_t start = time_us_32();
+        uint32_t ints = flash_lock();
         flash_range_erase(flash_offs, count);
+        flash_unlock(ints);
+        stats.erase_us += time_us_32() - start;
+
+        // Counted the way flash_range_erase erases, 64K blocks where they are aligned and sectors otherwise
+        for (uint32_t offs = flash_offs, end = flash_offs + count; offs < end;) {
+            if (!(offs % FLASH_BLOCK64_SIZE) && ((end - offs) >= FLASH_BLOCK64_SIZE)) {
+                stats.blocks_erased++;
+                offs += FLASH_BLOCK64_SIZE;
+            } else {
+                stats.sectors_erased++;
+                offs += SECTOR_SIZE;
+            }
+        }
+    }
 }
 
-// After we've received a data hexline, buffer that data into the flashbuffer.
-// If the flashbuffer is full, then write the buffer to flash memory at the
-// programming address. If there's no more space in the erased sector of
-// flash memory, then erase the next sector before programming.
-void flash_intake(uint16_t address, unsigned char *src, size_t sz) {
+// flash_range_erase only ever issues 64K block or sector erases, so 32K blocks are erased by hand.
+// Polls for completion under flash_lock as nothing may execute from flash until it is done.
+static void __not_in_flash_func(flash_erase_block32)(uint32_t flash_offs) {
+    if (flash_offs >= (FLASH_HEADER_ORIGIN - XIP_BASE)) {
+        uint8_t tx[4] = {FLASH_CMD_WRITE_ENABLE};
+        uint8_t rx[4];
+        uint32_t start = time_us_32();
+        uint32_t ints = flash_lock();
+
+        flash_do_cmd(tx, rx, 1);
+        tx[0] = FLASH_CMD_BLOCK32_ERASE;
+        tx[1] = flash_offs >> 16;
+        tx[2] = flash_offs >> 8;
+        tx[3] = flash_offs;
+        flash_do_cmd(tx, rx, 4);
+
+        tx[0] = FLASH_CMD_READ_STATUS;
+        do {
+            flash_do_cmd(tx, rx, 2);
+        } while (rx[1] & FLASH_STATUS_BUSY);
+
+        flash_unlock(ints);
+        stats.erase_us += time_us_32() - start;
+        stats.blocks_erased++;
+    }
+}
 
-    if (((programming_address + flashdex) & 0xFFFF) < address) {
-        static unsigned char zero = 0;
-        size_t diff = address - (programming_address + flashdex);
+// Whether the sector in flash already holds exactly what the job would leave there
+static bool __not_in_flash_func(flash_matches)(const flash_job_t *job) {
+    const uint32_t *flash = (const uint32_t *)(XIP_BASE + job->address);
+    const uint32_t *data = (const uint32_t *)job->data;
+    uint32_t programmed = (job->pages * PAGE_SIZE) / sizeof(uint32_t);
+    uint32_t i = 0;
 
-        for (size_t i = 0; i < diff; i++) {
-            flash_intake(0, &zero, 1);
-        }
+    for (; i < programmed; i++) {
+        if (flash[i] != data[i])
+            return false;
+    }
+
+    // Pages that are not programmed are left erased
+    for (; i < SECTOR_SIZE / sizeof(uint32_t); i++) {
+        if (flash[i] != 0xFFFFFFFFu)
+            return false;
+    }
+
+    return true;
+}
+
+// Program a page and read it back past the XIP cache. A page that did not take is programmed over itself once
+// more, which clears bits that did not clear the first time.
+static bool __not_in_flash_func(flash_program_page)(uint32_t flash_offs, const uint8_t *data) {
+    uint32_t crc = dma_crc32(data, PAGE_SIZE);
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        flash_write(flash_offs, data, PAGE_SIZE);
+        if (dma_crc32((const uint8_t *)(XIP_NOCACHE_NOALLOC_BASE + flash_offs), PAGE_SIZE) == crc)
+            return true;
+        stats.pages_retried++;
     }
 
-    // if ((((programming_address + flashdex) & 0xFFFF) != address) && (address != 0x0)) {
-    //     blink(LED_PIN, 4, 250);
-    // }
-
-    for (int i = 0; i < sz; i++) {
-        // Store a byte from the data buffer into the flashbuffer.
-        // Increment the flashdex. This will overflow from 255->0.
-        flashbuffer[flashdex] = src[i];
-        flashdex++;
-
-        // Did we just overflow to zero? If so, it's time to program
-        // the buffer into flash memory.
-        if (flashdex == 0) {
-            // Is there space remaining in the erased sector?
-            // If so ...
-            if (programming_address < erasure_address) {
-                // If this is the first page, copy it to the first_page_buffer
-                // and reset first_page
-                // if (!first_page) {
-                //     // Copy contents of flashbuffer to first_page_buffer
-                //     dma_channel_set_read_addr(dma_flash_copy, flashbuffer, false);
-                //     dma_channel_set_write_addr(dma_flash_copy, first_page_buffer, true);
-                //     dma_channel_wait_for_finish_blocking(dma_flash_copy);
-                //     // Reset first_page
-                //     first_page = 1;
-                // } else {
-                // Program flash memory at the programming address
-                flash_write(programming_address, flashbuffer, PAGE_SIZE);
-                // }
-            } else { // If not ...
-                     // Erase the next sector (4096 bytes)
-                flash_erase(erasure_address, SECTOR_SIZE);
-
-                // Increment the erasure pointer by 4096 bytes
-                erasure_address += SECTOR_SIZE;
-
-                // Program flash memory at the programming address
-                flash_write(programming_address, flashbuffer, PAGE_SIZE);
+    return false;
+}
+
+// Whether the journal still has the program sector at flash offset offs to be sent
+static bool __not_in_flash_func(flash_journal_pending)(uint32_t offs) {
+    uint32_t sector = (offs - (FLASH_MAIN_ORIGIN - XIP_BASE)) / SECTOR_SIZE;
+    return journal.fields.pending[sector / 32] & (1u << (sector % 32));
+}
+
+// Take the program sector at flash offset offs off the journal, only in RAM until the next flash_journal_sync
+static bool __not_in_flash_func(flash_journal_clear)(uint32_t offs) {
+    if (!journal_open || (offs < (FLASH_MAIN_ORIGIN - XIP_BASE)) || ((offs - (FLASH_MAIN_ORIGIN - XIP_BASE)) >= journal.fields.size) || !flash_journal_pending(offs))
+        return false;
+
+    uint32_t sector = (offs - (FLASH_MAIN_ORIGIN - XIP_BASE)) / SECTOR_SIZE;
+    journal.fields.pending[sector / 32] &= ~(1u << (sector % 32));
+    return true;
+}
+
+// A journal page that will not program only costs sectors being sent again
+static void __not_in_flash_func(flash_journal_sync)(void) {
+    flash_program_page((FLASH_HEADER_ORIGIN - XIP_BASE) + FLASH_JOURNAL_OFFSET, journal.page);
+}
+
+// A sector that holds everything it is going to is done, a partially filled one still needs the rest sent
+static void __not_in_flash_func(flash_journal_done)(const flash_job_t *job) {
+    if (job->complete && flash_journal_clear(job->address))
+        flash_journal_sync();
+}
+
+bool __not_in_flash_func(flash_service)(void) {
+    if (writing == NULL)
+        return false;
+
+    if (!writing->compared) {
+        // Skip erasing and programming sectors that are unchanged
+        writing->compared = true;
+        if (flash_matches(writing)) {
+            stats.sectors_skipped++;
+            flash_journal_done(writing);
+            writing = NULL;
+        }
+    } else if (!writing->erased) {
+        flash_erase(writing->address, SECTOR_SIZE);
+        writing->erased = true;
+    } else {
+        uint32_t offs = writing->page * PAGE_SIZE;
+
+        if (flash_program_page(writing->address + offs, writing->data + offs)) {
+            if (++writing->page == writing->pages) {
+                flash_journal_done(writing);
+                writing = NULL;
             }
+        } else if (writing->retries++ < FLASH_SECTOR_RETRIES) {
+            // Bits that were cleared when they should not have been only come back with an erase
+            writing->erased = false;
+            writing->page = 0;
+        } else {
+            // The sector's CRC32 was taken from the data, so flash_finalize has to be told
+            if (stats.failed_address == 0)
+                stats.failed_address = XIP_BASE + writing->address + offs;
+            writing = NULL;
+        }
+    }
 
-            // Increment the programming address by page size (256 bytes)
-            programming_address += PAGE_SIZE;
+    return writing != NULL;
+}
+
+// The journal left in flash by an interrupted transfer of the program with this CRC32 and size, NULL if there is none
+static const flash_journal_t *flash_journal_find(uint32_t crc, uint32_t size) {
+    const flash_journal_t *stored = (const flash_journal_t *)(FLASH_HEADER_ORIGIN + FLASH_JOURNAL_OFFSET);
+
+    if ((stored->magic != FLASH_JOURNAL_MAGIC) || (stored->crc != crc) || (stored->size != size))
+        return NULL;
+    return stored;
+}
+
+uint32_t flash_resume_point(uint32_t crc, uint32_t size) {
+    const flash_journal_t *stored = flash_journal_find(crc, size);
+    uint32_t sectors = (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    uint32_t sector = 0;
+
+    if ((stored == NULL) || (size > FLASH_MAIN_LENGTH))
+        return 0;
+
+    while ((sector < sectors) && !(stored->pending[sector / 32] & (1u << (sector % 32))))
+        sector++;
+    return sector;
+}
+
+#if defined(FLASH_ERASE_FROM_HEADER)
+// Whether a program sector has to be erased before the held header's program is written, it is pending in the journal
+// and what flash holds does not match the header's sector table. Sectors that match are left to compare equal and be
+// skipped, an image flashed over itself erases nothing.
+static bool flash_sector_stale(uint32_t sector) {
+    uint32_t size = journal.fields.size;
+    uint32_t sectors = *((uint32_t *)(header + FLASH_HEADER_SECTORS_OFFSET));
+    const uint32_t *table = (const uint32_t *)(header + FLASH_HEADER_TABLE_OFFSET);
+    uint32_t offset = sector * SECTOR_SIZE;
+
+    if (!flash_journal_pending((FLASH_MAIN_ORIGIN - XIP_BASE) + offset))
+        return false;
+
+    // No CRC32 to go by, the sector table was not received
+    if ((sector >= sectors) || ((FLASH_HEADER_TABLE_OFFSET + ((sector + 1) * sizeof(uint32_t))) > fill_end))
+        return true;
+
+    uint32_t len = ((size - offset) < SECTOR_SIZE) ? (size - offset) : SECTOR_SIZE;
+    return dma_crc32((uint8_t *)(FLASH_MAIN_ORIGIN + offset), len) != table[sector];
+}
+
+// Erase every run of sectors that are stale, all of the program unless flash already holds some of it
+static void flash_erase_pending(void) {
+    uint32_t sectors = (journal.fields.size + SECTOR_SIZE - 1) / SECTOR_SIZE;
 
-            // Clear the flashbuffer. Flashdex autowraps to 0.
-            dma_channel_set_write_addr(dma_flash_clear, flashbuffer, true);
-            dma_channel_wait_for_finish_blocking(dma_flash_clear);
+    for (uint32_t sector = 0; sector < sectors;) {
+        if (!flash_sector_stale(sector)) {
+            sector++;
+            continue;
         }
+
+        uint32_t run = sector + 1;
+        while ((run < sectors) && flash_sector_stale(run))
+            run++;
+        flash_erase_range(FLASH_MAIN_ORIGIN + (sector * SECTOR_SIZE), (run - sector) * SECTOR_SIZE);
+        sector = run;
     }
-    toggle(LED_PIN);
 }
+#endif
+
+// Keep the incoming flash header aside and erase the current one, the old program can no longer be booted
+// and the new one cannot be booted until flash_finalize has checked it. The header sector then journals
+// the transfer, unless it already journals an interrupted transfer of the same program, which is carried on.
+static void flash_hold_header(void) {
+    memcpy(header, filling->data, SECTOR_SIZE);
+    header_pages = (fill_end + PAGE_SIZE - 1) / PAGE_SIZE;
+    journal_open = false;
+
+    // What follows the sector table is padding, the journal's page is never programmed with it
+    if (header_pages > (FLASH_JOURNAL_OFFSET / PAGE_SIZE))
+        header_pages = FLASH_JOURNAL_OFFSET / PAGE_SIZE;
+
+    uint32_t crc = *((uint32_t *)(header + FLASH_HEADER_CRC_OFFSET));
+    uint32_t size = *((uint32_t *)(header + FLASH_HEADER_CRC_SZ_OFFSET));
+    if ((fill_end < (FLASH_HEADER_CRC_SZ_OFFSET + sizeof(uint32_t))) || (size > FLASH_MAIN_LENGTH)) {
+        flash_erase(FLASH_HEADER_ORIGIN - XIP_BASE, SECTOR_SIZE);
+        return;
+    }
 
-void flash_new_address(uint32_t address) {
-    address -= XIP_BASE;
+    const flash_journal_t *stored = flash_journal_find(crc, size);
+    if (stored != NULL) {
+        memcpy(journal.page, stored, PAGE_SIZE);
+    } else {
+        flash_erase(FLASH_HEADER_ORIGIN - XIP_BASE, SECTOR_SIZE);
+        memset(journal.page, 0xFF, PAGE_SIZE);
+        journal.fields.magic = FLASH_JOURNAL_MAGIC;
+        journal.fields.crc = crc;
+        journal.fields.size = size;
+        flash_journal_sync();
+    }
+    journal_open = true;
+
+#if defined(FLASH_ERASE_FROM_HEADER)
+    // The whole program follows the header, so everything it covers that has changed can be erased in as few commands
+    // as possible. Sectors that have not, or that an interrupted transfer already wrote, compare equal and are skipped.
+    flash_erase_pending();
+#endif
+}
+
+// Hand the filling job over to be written and start filling the other buffer with the following sector.
+// Only blocks if the previous job is still being written.
+static void flash_submit(void) {
+    // Nothing but gaps, the sector is left as it is
+    if (fill_end == 0) {
+        fill_offset = 0;
+        return;
+    }
+
+    while (flash_service()) {
+    }
 
-    // Flash remaining data from flash buffer to sector
-    if (flashdex) {
-        // IMPROVE: better handle for overflow in the case of switching to a new address
-        if (programming_address < erasure_address) {
-            // Program flash memory at the programming address
-            flash_write(programming_address, flashbuffer, PAGE_SIZE);
-        } else { // If not . . .
-                 // Erase the next sector (4096 bytes)
-            flash_erase(erasure_address, SECTOR_SIZE);
-            // Program flash memory at the programming address
-            flash_write(programming_address, flashbuffer, PAGE_SIZE);
+    flash_job_t *job = filling;
+    job->compared = false;
+    job->erased = false;
+    job->page = 0;
+    job->pages = (fill_end + PAGE_SIZE - 1) / PAGE_SIZE;
+    job->complete = (fill_offset == SECTOR_SIZE);
+    job->retries = 0;
+
+    if (job->address == (FLASH_HEADER_ORIGIN - XIP_BASE)) {
+        flash_hold_header();
+    } else if ((job->address >= (FLASH_MAIN_ORIGIN - XIP_BASE)) && (job->address < (FLASH_MAIN_ORIGIN + FLASH_MAIN_LENGTH - XIP_BASE))) {
+        // The last sector of the program is only checksummed as far as it was filled and gaps count as 0xFF,
+        // the same as imgtool
+        uint32_t sector = (job->address - (FLASH_MAIN_ORIGIN - XIP_BASE)) / SECTOR_SIZE;
+        sector_crcs[sector] = dma_crc32(job->data, fill_offset);
+        sector_written[sector / 32] |= 1u << (sector % 32);
+
+        // Already erased up front, it only needs programming
+        if (sector_erased[sector / 32] & (1u << (sector % 32))) {
+            sector_erased[sector / 32] &= ~(1u << (sector % 32));
+            job->compared = true;
+            job->erased = true;
         }
-        // NOTE: This sector may be partially full, but *should* not be accessed again
+        writing = job;
     }
+    // Anything below the flash header is the bootloader, which is never written, and anything past the program
+    // region is not flash the program may use, it is dropped
+
+    filling = (job == &jobs[0]) ? &jobs[1] : &jobs[0];
+    filling->address = job->address + SECTOR_SIZE;
+    fill_offset = 0;
+    fill_end = 0;
 
-    // Clear the flashbuffer
-    dma_channel_set_write_addr(dma_flash_clear, flashbuffer, true);
+    // Clear the new filling job
+    dma_channel_set_write_addr(dma_flash_clear, filling->data, true);
     dma_channel_wait_for_finish_blocking(dma_flash_clear);
+}
+
+// Move the cursor forward over bytes that are not part of the image. Within a sector they stay 0xFF, the same as
+// erased flash, so they need no programming. Sectors that are skipped entirely are not touched at all.
+static void flash_skip(uint32_t len) {
+    if (len < (SECTOR_SIZE - fill_offset)) {
+        fill_offset += len;
+        return;
+    }
+
+    // The rest of the sector is a gap too
+    uint32_t target = filling->address + fill_offset + len;
+    fill_offset = SECTOR_SIZE;
+    flash_submit();
+
+    // Sectors in between have nothing to be sent for them, so a resumed transfer need not stop at them
+    for (uint32_t offs = filling->address; offs < (target & ~(SECTOR_SIZE - 1)); offs += SECTOR_SIZE)
+        flash_journal_clear(offs);
 
-    // Reset the flashdex to 0
-    flashdex = 0;
+    filling->address = target & ~(SECTOR_SIZE - 1);
+    fill_offset = target % SECTOR_SIZE;
+}
+
+// After we've received a data hexline, buffer that data into the filling job.
+// Once a sector worth of data has been buffered, it is handed off to be
+// erased and programmed by flash_service while the next sector is filled.
+void flash_intake(uint16_t address, unsigned char *src, size_t sz) {
+    uint16_t cursor = (filling->address + fill_offset) & 0xFFFF;
+
+    if (cursor < address)
+        flash_skip(address - cursor);
 
-    // Erase the next sector defined by address (4096 bytes)
-    flash_erase(address, SECTOR_SIZE);
+    while (sz) {
+        size_t len = SECTOR_SIZE - fill_offset;
+        if (len > sz)
+            len = sz;
 
-    // Set the programming address and next sector to erase
-    programming_address = address;
-    erasure_address = address + SECTOR_SIZE;
+        memcpy(&filling->data[fill_offset], src, len);
+        fill_offset += len;
+        fill_end = fill_offset;
+        src += len;
+        sz -= len;
+
+        // Sector is full, pass it on to be written
+        if (fill_offset == SECTOR_SIZE)
+            flash_submit();
+    }
+    led_activity();
 }
 
-void flash_finalize() {
-    // We may have a partially-full buffer when we get the end of file hexline.
-    // If so, write that last buffer to flash memory.
+void flash_new_address(uint32_t address) {
+    address -= XIP_BASE;
 
-    // Program the final flashbuffer.
-    // Is there space remaining in the erased sector?
-    // If so . . .
-    if (programming_address < erasure_address) {
-        // Program flash memory at the programming address
-        flash_write(programming_address, flashbuffer, PAGE_SIZE);
-    } else { // If not . . .
-             // Erase the next sector (4096 bytes)
-        flash_erase(erasure_address, SECTOR_SIZE);
-        // Program flash memory at the programming address
-        flash_write(programming_address, flashbuffer, PAGE_SIZE);
+    uint32_t cursor = filling->address + fill_offset;
+    if (address >= cursor) {
+        flash_skip(address - cursor);
+        return;
     }
 
-    // We program the first page LAST, since we use it to figure out if there's
-    // a valid program to vector into.
-    // flash_write(FLASH_MAIN_ORIGIN - XIP_BASE, first_page_buffer, PAGE_SIZE);
-    // TODO: use a crc header instead of static values
+    // Jumping back, pass on remaining data for the previous address
+    // NOTE: This sector may be partially full, but *should* not be accessed again
+    flash_submit();
+
+    // The sector holding address gets erased once its job is written, anything before address in it is lost
+    filling->address = address & ~(SECTOR_SIZE - 1);
+    fill_offset = address % SECTOR_SIZE;
 }
 
-// Initializes erasure address and programming address.
-// Clears the flashbuffer, zeroes the flashdex.
-// Erases the first sector of flash, and increments erasure
-// address by the sector size (4096 bytes).
-// void flash_start() {
-//     // Reset the erasure pointer
-//     erasure_address = MAIN_APP_FLASH_OFFSET;
+bool flash_in_range(uint32_t address, uint32_t length) {
+    return (address >= FLASH_HEADER_ORIGIN) && (address <= (FLASH_MAIN_ORIGIN + FLASH_MAIN_LENGTH)) && (length <= ((FLASH_MAIN_ORIGIN + FLASH_MAIN_LENGTH) - address));
+}
 
-//     // Reset the programming pointer
-//     programming_address = MAIN_APP_FLASH_OFFSET;
+bool flash_erase_range(uint32_t address, uint32_t length) {
+    if ((address < FLASH_MAIN_ORIGIN) || (length > FLASH_MAIN_LENGTH) || ((address - FLASH_MAIN_ORIGIN) > (FLASH_MAIN_LENGTH - length)))
+        return false;
 
-//     // // Clear the flashbuffer
-//     // dma_channel_set_write_addr(dma_flash_clear, flashbuffer, true);
-//     // dma_channel_wait_for_finish_blocking(dma_flash_clear);
+    uint32_t offs = (address - XIP_BASE) & ~(SECTOR_SIZE - 1);
+    uint32_t end = ((address - XIP_BASE) + length + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
 
-//     // Reset the first_page flag to 0
-//     first_page = 0;
+    // Nothing may be erased from under a job that is still being written
+    while (flash_service()) {
+    }
+    led_set(LED_Erasing);
+
+    while (offs < end) {
+        uint32_t step;
+
+        if (!(offs % FLASH_BLOCK64_SIZE) && ((end - offs) >= FLASH_BLOCK64_SIZE)) {
+            // Every whole 64K block in one go, flash_range_erase issues the block erases itself
+            step = (end - offs) & ~(FLASH_BLOCK64_SIZE - 1);
+            flash_erase(offs, step);
+        } else if (!(offs % FLASH_BLOCK32_SIZE) && ((end - offs) >= FLASH_BLOCK32_SIZE)) {
+            step = FLASH_BLOCK32_SIZE;
+            flash_erase_block32(offs);
+        } else {
+            step = SECTOR_SIZE;
+            flash_erase(offs, SECTOR_SIZE);
+        }
 
-//     // Erase the first sector (4096 bytes)
-//     flash_erase(erasure_address, SECTOR_SIZE);
+        for (uint32_t sector = (offs - (FLASH_MAIN_ORIGIN - XIP_BASE)) / SECTOR_SIZE; step; step -= SECTOR_SIZE, sector++) {
+            sector_erased[sector / 32] |= 1u << (sector % 32);
+            offs += SECTOR_SIZE;
+        }
+    }
 
-//     // Increment the erasure pointer by 4096 bytes
-//     erasure_address += SECTOR_SIZE;
-// }
\ No newline at end of file
+    led_set(LED_Receiving);
+    return true;
+}
+
+const flash_stats_t *flash_get_stats(void) {
+    return &stats;
+}
+
+// Check every sector of the program against the sector table, using the CRC32s taken while writing where there are any
+static bool flash_check_sectors(const uint8_t *hdr) {
+    uint32_t size = *((uint32_t *)(hdr + FLASH_HEADER_CRC_SZ_OFFSET));
+    uint32_t sectors = *((uint32_t *)(hdr + FLASH_HEADER_SECTORS_OFFSET));
+    const uint32_t *table = (const uint32_t *)(hdr + FLASH_HEADER_TABLE_OFFSET);
+
+    for (uint32_t sector = 0; sector < sectors; sector++) {
+        uint32_t offset = sector * SECTOR_SIZE;
+        uint32_t len = ((size - offset) < SECTOR_SIZE) ? (size - offset) : SECTOR_SIZE;
+        uint32_t crc;
+
+        // The CRC32 taken of a short last sector covers however far it was filled, which is past the end of the
+        // program when the input skips on beyond it, so that one is read back like the sectors not written
+        if ((sector_written[sector / 32] & (1u << (sector % 32))) && (len == SECTOR_SIZE)) {
+            crc = sector_crcs[sector];
+        } else {
+            // Not part of this session, it has to already be in flash
+            crc = dma_crc32((uint8_t *)(FLASH_MAIN_ORIGIN + offset), len);
+        }
+
+        if (crc != table[sector])
+            return false;
+    }
+
+    return true;
+}
+
+// Program the held back flash header, the first page holds the magic so it goes last. The journal is closed
+// after it, a transfer cut short before then is still carried on by the next one.
+static bool flash_commit_header(void) {
+    for (uint16_t page = header_pages; page-- > 0;) {
+        if (!flash_program_page((FLASH_HEADER_ORIGIN - XIP_BASE) + (page * PAGE_SIZE), header + (page * PAGE_SIZE))) {
+            stats.failed_address = FLASH_HEADER_ORIGIN + (page * PAGE_SIZE);
+            return false;
+        }
+    }
+
+    if (journal_open) {
+        journal.fields.magic = 0;
+        flash_journal_sync();
+        journal_open = false;
+    }
+    return true;
+}
+
+bool flash_finalize() {
+    // We may have a partially-full sector when we get the end of file hexline.
+    flash_submit();
+
+    // Wait for everything to be written
+    while (flash_service()) {
+    }
+
+    // A page that would not program, the journal still has its sector to be sent again
+    if (stats.failed_address)
+        return false;
+
+    const uint8_t *hdr = header_pages ? header : (const uint8_t *)FLASH_HEADER_ORIGIN;
+    uint32_t version = *((uint32_t *)(hdr + FLASH_HEADER_VERSION_OFFSET));
+    uint32_t size = *((uint32_t *)(hdr + FLASH_HEADER_CRC_SZ_OFFSET));
+    uint32_t sectors = *((uint32_t *)(hdr + FLASH_HEADER_SECTORS_OFFSET));
+
+    if ((version != FLASH_HEADER_VERSION) || (size > FLASH_MAIN_LENGTH) || (sectors != ((size + SECTOR_SIZE - 1) / SECTOR_SIZE))) {
+        // Without a sector table the only option is to read the program back once the header is in place
+        if (header_pages && !flash_commit_header())
+            return false;
+        return check_flash_crc32();
+    }
+
+    if (!flash_check_sectors(hdr)) {
+        // Something the journal took as done is not, the next transfer has to start over
+        if (journal_open) {
+            flash_erase(FLASH_HEADER_ORIGIN - XIP_BASE, SECTOR_SIZE);
+            journal_open = false;
+        }
+        return false;
+    }
+
+    return !header_pages || flash_commit_header();
+}
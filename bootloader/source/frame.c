@@ -0,0 +1,286 @@
+/**
+ * @file frame.c
+ * @author IR
+ * @brief Source file for the framed binary input scheme
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "frame.h"
+
+#include <pico/stdlib.h>
+
+#include "bootloader_config.h"
+
+#if defined(BOOT_INPUT_FRAME_STREAM)
+
+    #include <string.h>
+
+    #include "bootloader.h"
+    #include "dma_util.h"
+    #include "flash.h"
+    #include "led.h"
+    #include "lz.h"
+    #include "transport.h"
+
+/**
+ * @brief A frame exactly as it was received, header, payload and CRC32
+ */
+typedef struct frame_slot {
+    bool full;
+    union {
+        frame_header_t header;
+        uint8_t raw[sizeof(frame_header_t) + FRAME_PAYLOAD_MAX + sizeof(uint32_t)];
+    };
+} frame_slot_t;
+
+// One slot per outstanding frame plus a spare that is always being received into
+static frame_slot_t slots[FRAME_WINDOW + 1];
+static frame_slot_t *window[FRAME_WINDOW];
+static frame_slot_t *spare;
+
+static uint16_t expected_seq; // Next sequence number to be written to flash
+static bool nak_sent;         // Whether expected_seq has already been NAKed
+static uint32_t next_address; // Address following the last written frame
+static lz_stream_t lz;        // Decompression history, spans every ZDATA frame of a session
+
+// Decompressed data goes straight into the flash buffers
+static void frame_inflate(const uint8_t *data, uint32_t len) {
+    flash_intake(next_address & 0xFFFF, (unsigned char *)data, len);
+    next_address += len;
+}
+
+static void frame_reset(uint16_t seq) {
+    for (int i = 0; i < FRAME_WINDOW; i++) {
+        window[i] = &slots[i];
+        window[i]->full = false;
+    }
+    spare = &slots[FRAME_WINDOW];
+    expected_seq = seq;
+    nak_sent = false;
+    next_address = 0;
+    lz_init(&lz, frame_inflate);
+}
+
+static void frame_reply(FrameReplyCode code, uint16_t seq, uint32_t value) {
+    frame_reply_t reply = {FRAME_REPLY_SYNC, code, seq, value};
+
+    transport_write(&reply, sizeof(reply));
+    transport_flush();
+}
+
+// Ask for the first missing frame, once per gap. The host falls back to its own timeout otherwise.
+static void frame_nak(void) {
+    if (!nak_sent) {
+        frame_reply(FRAME_NAK, expected_seq, 0);
+        nak_sent = true;
+    }
+}
+
+/**
+ * @brief Receive a single frame into a slot
+ *
+ * @param slot Slot to receive into
+ * @retval true A complete frame with a valid CRC was received
+ * @retval false The frame was truncated or corrupt
+ */
+static bool frame_receive(frame_slot_t *slot) {
+    uint32_t sync = 0;
+    uint32_t crc;
+
+    // Hunt for the start of a frame
+    while (sync != FRAME_MAGIC) {
+        sync = (sync >> 8) | ((uint32_t)(uint8_t)transport_getchar_serviced(0) << 24);
+    }
+    slot->header.magic = sync;
+
+    if (!transport_read_serviced(slot->raw + sizeof(sync), sizeof(frame_header_t) - sizeof(sync), FRAME_BYTE_TIMEOUT_US))
+        return false;
+
+    if (slot->header.length > FRAME_PAYLOAD_MAX)
+        return false;
+
+    uint sz = sizeof(frame_header_t) + slot->header.length;
+    if (!transport_read_serviced(slot->raw + sizeof(frame_header_t), slot->header.length + sizeof(crc), FRAME_BYTE_TIMEOUT_US))
+        return false;
+
+    memcpy(&crc, slot->raw + sz, sizeof(crc));
+    return crc == dma_crc32(slot->raw, sz);
+}
+
+/**
+ * @brief Check that data fits in flash and move the flash writer to it
+ *
+ * @param address Address the data is written to
+ * @param length Length of the data
+ * @retval true Data may be written
+ * @retval false Data is out of range or jumps back to the middle of a sector
+ */
+static bool frame_seek(uint32_t address, uint32_t length) {
+    if (!flash_in_range(address, length))
+        return false;
+
+    if (address != next_address) {
+        // Jumping back into a sector would erase what it already holds
+        if ((address < next_address) && (address % SECTOR_SIZE))
+            return false;
+        flash_new_address(address);
+        next_address = address;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Act on a frame that is next in sequence
+ *
+ * @param slot Slot holding the frame
+ * @param done Set when the session has been completed
+ * @retval true Frame was handled
+ * @retval false Frame could not be handled
+ */
+static bool frame_deliver(frame_slot_t *slot, bool *done) {
+    uint32_t address = slot->header.address;
+    uint16_t length = slot->header.length;
+    uint8_t *payload = slot->raw + sizeof(frame_header_t);
+
+    switch (slot->header.type) {
+        case FRAME_Data:
+            if (!frame_seek(address, length))
+                return false;
+
+            flash_intake(address & 0xFFFF, payload, length);
+            next_address = address + length;
+            return true;
+        case FRAME_ZData: {
+            uint16_t inflated = slot->header.extent;
+            if ((inflated > FRAME_INFLATED_MAX) || !frame_seek(address, inflated))
+                return false;
+
+            // frame_inflate advances next_address as data comes out
+            return lz_decode(&lz, payload, length, inflated) == inflated;
+        }
+        case FRAME_Erase:
+            if (address % SECTOR_SIZE)
+                return false;
+            return flash_erase_range(address, slot->header.extent * SECTOR_SIZE);
+        case FRAME_End:
+            if (!flash_finalize())
+                return false;
+            *done = true;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void frame_init(void) {
+    transport_init();
+    frame_reset(0);
+}
+
+void frame_deinit(void) {
+    transport_puts("Branching\n");
+    transport_deinit();
+}
+
+bool frame_load(void) {
+    while (true) {
+        if (!frame_receive(spare)) {
+            led_fault();
+            frame_nak();
+            continue;
+        }
+
+        frame_header_t *header = &spare->header;
+
+        if (header->type == FRAME_Hello) {
+            frame_reset(header->seq + 1);
+            frame_reply(FRAME_ACK, header->seq, (FRAME_WINDOW << 16) | FRAME_PAYLOAD_MAX);
+            continue;
+        }
+
+        // Lets the host skip sending an image that is already flashed
+        if (header->type == FRAME_Query) {
+            if (check_flash_crc32())
+                frame_reply(FRAME_ACK, header->seq, *((uint32_t *)(FLASH_HEADER_ORIGIN + FLASH_HEADER_CRC_OFFSET)));
+            else
+                frame_reply(FRAME_NAK, header->seq, 0);
+            continue;
+        }
+
+        // Lets the host find the sectors that differ from the image it is about to send
+        if (header->type == FRAME_Sector) {
+            uint32_t address = header->address;
+            uint16_t extent = header->extent;
+
+            if ((extent > SECTOR_SIZE) || !flash_in_range(address, extent))
+                frame_reply(FRAME_NAK, header->seq, 0);
+            else
+                frame_reply(FRAME_ACK, header->seq, dma_crc32((uint8_t *)address, extent));
+            continue;
+        }
+
+        // Lets the host carry on from where a transfer of the same program was cut short
+        if (header->type == FRAME_Resume) {
+            uint32_t program[2];
+
+            if (header->length != sizeof(program)) {
+                frame_reply(FRAME_NAK, header->seq, 0);
+            } else {
+                memcpy(program, spare->raw + sizeof(frame_header_t), sizeof(program));
+                frame_reply(FRAME_ACK, header->seq, flash_resume_point(program[0], program[1]));
+            }
+            continue;
+        }
+
+        uint16_t ahead = header->seq - expected_seq;
+
+        // Either already written (our ACK was lost) or beyond the window, restate where we are
+        if (ahead >= FRAME_WINDOW) {
+            frame_reply(FRAME_ACK, expected_seq - 1, 0);
+            continue;
+        }
+
+        uint idx = header->seq % FRAME_WINDOW;
+        if (!window[idx]->full) {
+            frame_slot_t *slot = window[idx];
+            window[idx] = spare;
+            window[idx]->full = true;
+            spare = slot;
+        }
+
+        // Hold on to frames that arrived early and ask for the missing one only
+        if (ahead) {
+            frame_nak();
+            continue;
+        }
+
+        // Write out everything that is now in sequence
+        bool done = false;
+        while (!done && window[expected_seq % FRAME_WINDOW]->full) {
+            frame_slot_t *slot = window[expected_seq % FRAME_WINDOW];
+
+            slot->full = false;
+            if (!frame_deliver(slot, &done)) {
+                frame_reply(FRAME_FAIL, expected_seq, flash_get_stats()->failed_address);
+                return false;
+            }
+
+            expected_seq++;
+            nak_sent = false;
+        }
+
+        frame_reply(FRAME_ACK, expected_seq - 1, 0);
+
+        if (done)
+            return true;
+    }
+}
+
+#elif defined(BOOT_INPUT_FRAME_SPI_FLASH)
+    #error "SPI Flash input for frames not defined"
+#endif
@@ -16,172 +16,60 @@
 #include "bootloader_config.h"
 #include "led.h"
 
-struct HEX_t HEX;
+#if defined(BOOT_INPUT_HEX_STREAM)
 
-#if defined(BOOT_INPUT_HEX_USB)
+    #include "transport.h"
 
-    #include <stdio.h>
+    // Characters handed to the parser at a time
+    #define CHUNK_LEN 64
 
-    #include "dma_util.h"
-    #include "hardware/dma.h"
+static char chunk[CHUNK_LEN];
+static uint32_t chunk_len; // Characters held in chunk
+static uint32_t chunk_pos; // Characters of chunk already parsed
 
-    // Length of our buffer (bytes)
-    #define BUFFER_LEN 44
-
-static volatile unsigned char buffer[BUFFER_LEN] = {0x00};
-static volatile unsigned char load_buffer[BUFFER_LEN] = {0x00};
-
-static uint32_t buf_count;   // Counts received bytes
-static int dma_checksum;     // Performs checksum
-static int dma_clear_buffer; // Clears buffer
-
-/**
- * @brief Retrieve and buffer a line of Hex (ASCII)
- *
- * @param buf Buffer to push to
- */
-void getLine(volatile unsigned char *buf) {
-    // Clear the buffer (DMA for speed)
-    dma_channel_set_write_addr(dma_clear_buffer, buf, true);
-    dma_channel_wait_for_finish_blocking(dma_clear_buffer);
-
-    // Count characters as we receive them
-    buf_count = 0;
-
-    // Buffer until the starting char ':'
-    char ch;
-
-    // FIXME: Handle case where ':' is not found / getchar timesout
-    do {
-        ch = getchar();
-    } while (ch != ':');
-
-    ch = getchar();
-
-    // FIXME: Handle case where no '\n' or '\r' is given
-    while ((ch != '\n') && (ch != '\r')) {
-        *buf++ = ch;
-        buf_count++;
-        ch = getchar();
-    };
-
-    // Null-terminate the string
-    *buf++ = 0;
-}
-
-void char2hex(volatile char val, unsigned char *num) {
-    if (val >= 'A')
-        *num |= val - 'A' + 10;
-    else
-        *num |= val - '0';
-}
-
-// Tranforms line from ASCII to binary representation
-void transformLine(volatile unsigned char *buf) {
-    uint32_t i = 0;
-
-    for (; i < buf_count / 2; i++) {
-        uint8_t num = 0;
-
-        char2hex(buf[i * 2], &num);
-        num <<= 4;
-        char2hex(buf[(i * 2) + 1], &num);
-
-        buf[i] = num;
-    }
-
-    // Zero-out the rest of the buffer
-    while (i < BUFFER_LEN) {
-        buf[i++] = 0;
-    }
-}
-
-// Performs a checksum on the received hex line
-uint32_t checkLine(volatile unsigned char *src, volatile unsigned char *dst) {
-
-    // Enable the sniffer
-    dma_sniffer_enable(dma_checksum, 0x0F, true);
-
-    // Reset the sniff register to zero
-    dma_sniffer_set_data_accumulator(0x00000000);
-
-    // Reset DMA read and write addresses, trigger and wait for finish
-    dma_channel_set_read_addr(dma_checksum, src, false);
-    dma_channel_set_write_addr(dma_checksum, dst, true);
-    dma_channel_wait_for_finish_blocking(dma_checksum);
-
-    // Return 2's complement of LSB of checksum. If zero, check passed
-    return ((~(dma_sniffer_get_data_accumulator()) + 1) & 0x000000FF);
+// Wait for at least one character, then take whatever else has already arrived
+static void fillChunk(void) {
+    chunk[0] = transport_getchar_serviced(0);
+    chunk_len = 1 + transport_read((uint8_t *)&chunk[1], CHUNK_LEN - 1);
+    chunk_pos = 0;
 }
 
-// Parse the verified line into length, address, type, data, and checksum
-void parseLine(volatile unsigned char *buf) {
+// Acquire a single hexline. Return 1 if valid, 0 if it was malformed or the checksum failed
+int acquireLine() {
+    transport_putchar(0);
+    transport_flush();
 
-    // Iterator
-    int i;
+    hex_parse_reset();
 
-    // Grab length, address, hextype
-    HEX.count = buf[0];
-    HEX.address = (buf[1] << 8) | buf[2];
-    HEX.type = buf[3];
+    while (true) {
+        uint32_t used;
 
-    // Grab the data
-    for (i = 0; i < HEX.count; i++) {
-        HEX.data[i] = buf[i + 4];
-    }
+        if (chunk_pos == chunk_len)
+            fillChunk();
 
-    // Grab the checksum
-    HEX.checksum = buf[HEX.count + 4];
-}
+        HexStatus status = hex_parse(&chunk[chunk_pos], chunk_len - chunk_pos, &used);
+        chunk_pos += used;
 
-// Acquire a single hexline. Return 1 if valid, 0 if checksum failed
-int acquireLine() {
-    // Did the checksum pass?
-    uint32_t valid;
-
-    putchar(0);
-    stdio_flush();
-
-    // Get a raw line of ASCII characters
-    getLine(buffer);
-
-    // Transform those ASCII characters to binary
-    transformLine(buffer);
-
-    // Perform a checksum
-    valid = checkLine(buffer, load_buffer);
-
-    // If passed, parse the line. Else return 0.
-    if (valid == 0) {
-        // Next line
-        putchar(1);
-        stdio_flush();
-        parseLine(load_buffer);
-        return 1;
-    } else {
-        blink(LED2_PIN, 1, 50);
-        return 0;
+        if (status == HEX_Record) {
+            // Next line
+            transport_putchar(1);
+            transport_flush();
+            return 1;
+        } else if (status == HEX_Invalid) {
+            led_fault();
+            return 0;
+        }
     }
 }
 
 void hex_init(void) {
-    stdio_usb_init();
-
-    dma_checksum = dma_init(load_buffer, buffer, BUFFER_LEN, DMA_SIZE_8, true, true);
-    dma_clear_buffer = dma_init(buffer, &nil, BUFFER_LEN, DMA_SIZE_8, false, true);
+    transport_init();
+    chunk_len = chunk_pos = 0;
 }
 
 void hex_deinit(void) {
-    // TODO: is there anyway / reason to deinit stdio_usb?
-
-    dma_deinit(dma_checksum);
-    dma_deinit(dma_clear_buffer);
-
-    // Disable the sniffer
-    dma_sniffer_disable();
-
-    puts("Branching\n");
-    stdio_flush();
+    transport_puts("Branching\n");
+    transport_deinit();
 }
 
 bool hex_load(void) {
@@ -0,0 +1,107 @@
+/**
+ * @file hex_parse.c
+ * @author IR
+ * @brief Source file for the Intel HEX record parser
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "hex.h"
+
+struct HEX_t HEX;
+
+static struct {
+    bool active;     // A ':' has been seen, characters belong to a record
+    bool low;        // Next digit is the low nibble of a byte
+    uint8_t high;    // High nibble of the byte being decoded
+    uint8_t sum;     // Running sum of the decoded bytes, zero for a valid record
+    uint16_t index;  // Bytes of the record decoded so far
+    uint16_t length; // Bytes in the record, count + address + type + data + checksum
+} parser;
+
+// Value of a hex digit, -1 if it is not one
+static inline int hex_digit(char ch) {
+    if ((ch >= '0') && (ch <= '9'))
+        return ch - '0';
+    if ((ch >= 'A') && (ch <= 'F'))
+        return ch - 'A' + 10;
+    if ((ch >= 'a') && (ch <= 'f'))
+        return ch - 'a' + 10;
+    return -1;
+}
+
+void hex_parse_reset(void) {
+    parser.active = false;
+}
+
+HexStatus hex_parse(const char *src, uint32_t len, uint32_t *used) {
+    HexStatus status = HEX_Pending;
+    uint32_t i = 0;
+
+    while ((i < len) && (status == HEX_Pending)) {
+        char ch = src[i++];
+
+        // A start code always begins a new record, even part way through another
+        if (ch == ':') {
+            parser.active = true;
+            parser.low = false;
+            parser.sum = 0;
+            parser.index = 0;
+            parser.length = 5;
+            continue;
+        }
+
+        if (!parser.active)
+            continue;
+
+        int digit = hex_digit(ch);
+        if (digit < 0) {
+            parser.active = false;
+            status = HEX_Invalid;
+            break;
+        }
+
+        if (!parser.low) {
+            parser.high = digit << 4;
+            parser.low = true;
+            continue;
+        }
+        parser.low = false;
+
+        uint8_t byte = parser.high | digit;
+        parser.sum += byte;
+
+        switch (parser.index) {
+            case 0:
+                HEX.count = byte;
+                parser.length = byte + 5;
+                break;
+            case 1:
+                HEX.address = byte << 8;
+                break;
+            case 2:
+                HEX.address |= byte;
+                break;
+            case 3:
+                HEX.type = byte;
+                break;
+            default:
+                if (parser.index < parser.length - 1)
+                    HEX.data[parser.index - 4] = byte;
+                else
+                    HEX.checksum = byte;
+                break;
+        }
+
+        if (++parser.index == parser.length) {
+            parser.active = false;
+            status = (parser.sum == 0) ? HEX_Record : HEX_Invalid;
+        }
+    }
+
+    *used = i;
+    return status;
+}
@@ -1,7 +1,7 @@
 /**
  * @file led.c
  * @author IR
- * @brief Source file for led utility functions
+ * @brief Source file for the bootloader's LED status engine
  * @version 0.1
  * @date 2024-04-06
  *
@@ -11,29 +11,109 @@
 
 #include "led.h"
 
+#include <hardware/pwm.h>
+
 #include "bootloader_config.h"
 
-void blink(uint gpio, uint32_t count, uint32_t ms) {
-    for (uint32_t i = 0; i < count; i++) {
-        gpio_put(gpio, 1);
-        sleep_ms(ms);
-        gpio_put(gpio, 0);
-        sleep_ms(ms);
+// Ticks LED2_PIN stays lit after led_fault
+#define LED_FAULT_TICKS 3
+
+static volatile LedPattern pattern;
+static volatile bool active;         // Data arrived since the last tick
+static volatile uint8_t fault_ticks; // Ticks left of a led_fault flash
+static uint32_t phase;               // Ticks since the pattern was set
+static repeating_timer_t timer;
+
+// Perceived brightness is roughly quadratic in duty cycle
+static void led_level(uint gpio, uint8_t brightness) {
+    pwm_set_gpio_level(gpio, brightness * brightness);
+}
+
+static bool led_tick(repeating_timer_t *t) {
+    (void)t;
+    uint8_t progress = 0;
+    uint8_t outcome = 0;
+
+    phase++;
+    switch (pattern) {
+        case LED_Idle: {
+            // Two second triangle
+            uint32_t p = phase % 100;
+            progress = ((p < 50) ? p : 100 - p) * 5;
+            break;
+        }
+        case LED_Receiving:
+            progress = (active && ((phase / 2) & 1)) ? 255 : 24;
+            active = false;
+            break;
+        case LED_Erasing:
+            progress = 255;
+            break;
+        case LED_Error:
+            outcome = ((phase / 6) & 1) ? 255 : 0;
+            break;
+        case LED_Done:
+            outcome = 255;
+            break;
+        default:
+            break;
     }
+
+    if (fault_ticks) {
+        fault_ticks--;
+        outcome = 255;
+    }
+
+    led_level(LED_PIN, progress);
+    led_level(LED2_PIN, outcome);
+    return true;
 }
 
-void toggle(uint gpio) {
-    gpio_put(gpio, !gpio_get(gpio));
+void led_set(LedPattern p) {
+    if (pattern != p) {
+        pattern = p;
+        phase = 0;
+    }
+}
+
+void led_activity(void) {
+    active = true;
+    if ((pattern == LED_Idle) || (pattern == LED_Error))
+        led_set(LED_Receiving);
+}
+
+void led_fault(void) {
+    fault_ticks = LED_FAULT_TICKS;
+}
+
+static void led_pwm_init(uint gpio) {
+    pwm_config config = pwm_get_default_config();
+
+    // Full 16 bit range for led_level, ~1.9kHz at 125MHz
+    pwm_config_set_wrap(&config, 0xFFFF);
+    gpio_set_function(gpio, GPIO_FUNC_PWM);
+    pwm_init(pwm_gpio_to_slice_num(gpio), &config, true);
+    pwm_set_gpio_level(gpio, 0);
 }
 
 void led_init() {
-    gpio_init(LED_PIN);
-    gpio_set_dir(LED_PIN, GPIO_OUT);
-    gpio_init(LED2_PIN);
-    gpio_set_dir(LED2_PIN, GPIO_OUT);
+    pattern = LED_Idle;
+    phase = 0;
+    active = false;
+    fault_ticks = 0;
+
+    led_pwm_init(LED_PIN);
+    led_pwm_init(LED2_PIN);
+
+    // Negative so ticks are LED_TICK_MS apart from start to start
+    add_repeating_timer_ms(-LED_TICK_MS, led_tick, NULL, &timer);
 }
 
 void led_deinit() {
+    cancel_repeating_timer(&timer);
+
+    pwm_set_enabled(pwm_gpio_to_slice_num(LED_PIN), false);
+    pwm_set_enabled(pwm_gpio_to_slice_num(LED2_PIN), false);
     gpio_deinit(LED_PIN);
     gpio_deinit(LED2_PIN);
-}
\ No newline at end of file
+}
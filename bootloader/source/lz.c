@@ -0,0 +1,97 @@
+/**
+ * @file lz.c
+ * @author IR
+ * @brief Source file for the streaming LZ decoder used for compressed images
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "lz.h"
+
+static void lz_flush(lz_stream_t *lz) {
+    while (lz->flushed != lz->pos) {
+        uint32_t start = lz->flushed % LZ_WINDOW;
+        uint32_t len = lz->pos - lz->flushed;
+
+        // The window wraps, hand over the part up to its end first
+        if (len > LZ_WINDOW - start)
+            len = LZ_WINDOW - start;
+
+        lz->sink(&lz->window[start], len);
+        lz->flushed += len;
+    }
+}
+
+// Pending data is flushed long before it could be overwritten, anything within LZ_WINDOW stays matchable
+static inline void lz_put(lz_stream_t *lz, uint8_t byte) {
+    lz->window[lz->pos++ % LZ_WINDOW] = byte;
+
+    if (lz->pos - lz->flushed == LZ_FLUSH)
+        lz_flush(lz);
+}
+
+// Add extension bytes to a length, stopping after the first one that is not 255
+static bool lz_length(const uint8_t **src, const uint8_t *end, uint32_t *len) {
+    uint8_t byte;
+
+    do {
+        if (*src == end)
+            return false;
+        byte = *(*src)++;
+        *len += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+void lz_init(lz_stream_t *lz, lz_sink_t sink) {
+    lz->sink = sink;
+    lz->pos = 0;
+    lz->flushed = 0;
+}
+
+int32_t lz_decode(lz_stream_t *lz, const uint8_t *src, uint32_t len, uint32_t limit) {
+    const uint8_t *end = src + len;
+    uint32_t start = lz->pos;
+
+    while (src < end) {
+        uint8_t token = *src++;
+
+        uint32_t literals = token >> 4;
+        if ((literals == 15) && !lz_length(&src, end, &literals))
+            return -1;
+        if ((literals > (uint32_t)(end - src)) || (literals > limit - (lz->pos - start)))
+            return -1;
+
+        while (literals--)
+            lz_put(lz, *src++);
+
+        // The last sequence of a block has no match
+        if (src == end)
+            break;
+
+        if ((end - src) < 2)
+            return -1;
+        uint32_t offset = src[0] | (src[1] << 8);
+        src += 2;
+        if ((offset == 0) || (offset > LZ_WINDOW) || (offset > lz->pos))
+            return -1;
+
+        uint32_t match = token & 0x0F;
+        if ((match == 15) && !lz_length(&src, end, &match))
+            return -1;
+        match += LZ_MIN_MATCH;
+        if (match > limit - (lz->pos - start))
+            return -1;
+
+        // Byte by byte, matches may overlap what they produce
+        while (match--)
+            lz_put(lz, lz->window[(lz->pos - offset) % LZ_WINDOW]);
+    }
+
+    lz_flush(lz);
+    return lz->pos - start;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file transport.c
+ * @author IR
+ * @brief Source file for reading from the link while flash writes are pending, common to every transport
+ * @details Input schemes wait on the link through these, so whatever time is spent waiting goes to erasing and
+ * programming the sectors already received.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "transport.h"
+
+#include "flash.h"
+
+int transport_getchar_serviced(uint32_t timeout_us) {
+    uint32_t start = time_us_32();
+    int ch;
+
+    while ((ch = transport_getchar_timeout_us(0)) == PICO_ERROR_TIMEOUT) {
+        if (flash_service())
+            continue;
+
+        if (timeout_us == 0)
+            return transport_getchar();
+
+        uint32_t waited = time_us_32() - start;
+        return (waited < timeout_us) ? transport_getchar_timeout_us(timeout_us - waited) : PICO_ERROR_TIMEOUT;
+    }
+
+    return ch;
+}
+
+bool transport_read_serviced(uint8_t *dst, uint32_t len, uint32_t timeout_us) {
+    while (len) {
+        // Whatever has already arrived is taken in one go, only waiting goes a character at a time
+        uint32_t n = transport_read(dst, len);
+        if (n == 0) {
+            int ch = transport_getchar_serviced(timeout_us);
+            if (ch == PICO_ERROR_TIMEOUT)
+                return false;
+            *dst = ch;
+            n = 1;
+        }
+        dst += n;
+        len -= n;
+    }
+    return true;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file transport_uart.c
+ * @author IR
+ * @brief Source file for the UART transport
+ * @details A DMA channel paced by the UART's RX DREQ writes into a ring buffer for as long as the bootloader runs.
+ * It needs no interrupts, so nothing is dropped while flash operations hold the CPU, the ring only has to cover the
+ * longest erase at the baud rate in use.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "transport.h"
+
+#include "bootloader_config.h"
+
+#if defined(BOOT_TRANSPORT_UART)
+
+    #include <hardware/dma.h>
+    #include <hardware/uart.h>
+    #include <string.h>
+
+    #define UART_RING_SIZE (1u << BOOT_UART_RING_BITS)
+    #define UART_RING_MASK (UART_RING_SIZE - 1)
+
+    // Transfers the channel is started with, about four hours of input at 3Mbaud
+    #define UART_RX_TRANSFERS 0xFFFFFFFFu
+
+// The DMA ring wraps on an address boundary, so the buffer has to be aligned to its size
+static uint8_t ring[UART_RING_SIZE] __attribute__((aligned(UART_RING_SIZE)));
+static int rx_dma = -1;
+static uint32_t tail;     // Index into ring of the next character to take
+static uint32_t consumed; // Characters taken from ring since transport_init
+
+/**
+ * @brief Characters waiting in ring
+ *
+ * @details Data is located by the channel's write address, which only moves once a write has landed. The transfer
+ * count says how many characters the channel has taken from the UART, if that is a whole ring ahead of what was
+ * taken out, the oldest ones were overwritten. Everything waiting is dropped then, the input schemes' checksums
+ * catch the gap and have it sent again.
+ */
+static uint32_t uart_available(void) {
+    dma_channel_hw_t *hw = dma_channel_hw_addr(rx_dma);
+    uint32_t head = (hw->write_addr - (uint32_t)(uintptr_t)ring) & UART_RING_MASK;
+    uint32_t received = UART_RX_TRANSFERS - hw->transfer_count;
+
+    if ((received - consumed) >= UART_RING_SIZE) {
+        tail = head;
+        consumed = received;
+        return 0;
+    }
+
+    return (head - tail) & UART_RING_MASK;
+}
+
+// Only once uart_available has found something
+static uint8_t uart_take(void) {
+    uint8_t c = ring[tail];
+    tail = (tail + 1) & UART_RING_MASK;
+    consumed++;
+    return c;
+}
+
+void transport_init(void) {
+    uart_init(BOOT_UART, BOOT_UART_BAUD);
+    gpio_set_function(BOOT_UART_TX_PIN, GPIO_FUNC_UART);
+    gpio_set_function(BOOT_UART_RX_PIN, GPIO_FUNC_UART);
+
+    rx_dma = dma_claim_unused_channel(true);
+    tail = consumed = 0;
+
+    dma_channel_config config = dma_channel_get_default_config(rx_dma);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, BOOT_UART_RING_BITS);
+    channel_config_set_dreq(&config, uart_get_dreq(BOOT_UART, false));
+    // Ahead of the flash job and CRC channels, the UART FIFO only holds 32 characters
+    channel_config_set_high_priority(&config, true);
+
+    dma_channel_configure(rx_dma, &config, ring, &uart_get_hw(BOOT_UART)->dr, UART_RX_TRANSFERS, true);
+}
+
+void transport_deinit(void) {
+    uart_tx_wait_blocking(BOOT_UART);
+
+    dma_channel_abort(rx_dma);
+    dma_channel_unclaim(rx_dma);
+    rx_dma = -1;
+
+    uart_deinit(BOOT_UART);
+    gpio_deinit(BOOT_UART_TX_PIN);
+    gpio_deinit(BOOT_UART_RX_PIN);
+}
+
+int transport_getchar_timeout_us(uint32_t timeout_us) {
+    uint32_t start = time_us_32();
+
+    while (!uart_available()) {
+        if ((time_us_32() - start) >= timeout_us)
+            return PICO_ERROR_TIMEOUT;
+        tight_loop_contents();
+    }
+
+    return uart_take();
+}
+
+int transport_getchar(void) {
+    while (!uart_available()) {
+        tight_loop_contents();
+    }
+
+    return uart_take();
+}
+
+uint32_t transport_read(uint8_t *dst, uint32_t len) {
+    uint32_t n = uart_available();
+    if (n > len)
+        n = len;
+
+    // At most two copies, up to the end of ring and on from its start
+    uint32_t first = UART_RING_SIZE - tail;
+    if (first > n)
+        first = n;
+    memcpy(dst, &ring[tail], first);
+    memcpy(dst + first, ring, n - first);
+
+    tail = (tail + n) & UART_RING_MASK;
+    consumed += n;
+    return n;
+}
+
+void transport_putchar(uint8_t c) {
+    uart_putc_raw(BOOT_UART, c);
+}
+
+void transport_write(const void *src, uint32_t len) {
+    const uint8_t *p = src;
+
+    while (len--) {
+        uart_putc_raw(BOOT_UART, *p++);
+    }
+}
+
+void transport_puts(const char *s) {
+    transport_write(s, strlen(s));
+}
+
+void transport_flush(void) {
+    uart_tx_wait_blocking(BOOT_UART);
+}
+
+#endif
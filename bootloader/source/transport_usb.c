@@ -0,0 +1,106 @@
+/**
+ * @file transport_usb.c
+ * @author IR
+ * @brief Source file for the USB CDC transport
+ * @details Input is read straight from the stdio_usb driver, a USB packet or more per call into a buffer the input
+ * schemes are fed from, rather than a character at a time through stdio. getchar_timeout_us takes the stdio mutex,
+ * walks the driver list and reads the CDC FIFO once for every character, which adds up to a good share of the CPU
+ * time spent receiving a program.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "transport.h"
+
+#include "bootloader_config.h"
+
+#if defined(BOOT_TRANSPORT_USB)
+
+    #include <pico/stdio_usb.h>
+    #include <string.h>
+
+    // Characters taken from the CDC FIFO at a time, matches its size
+    #define USB_RX_LEN 256
+
+static uint8_t rx_buf[USB_RX_LEN];
+static uint32_t rx_len; // Characters held in rx_buf
+static uint32_t rx_pos; // Characters of rx_buf already taken
+
+// Refill rx_buf from the CDC FIFO once everything in it has been taken
+static bool usb_available(void) {
+    if (rx_pos < rx_len)
+        return true;
+
+    int n = stdio_usb.in_chars((char *)rx_buf, USB_RX_LEN);
+    rx_len = (n > 0) ? n : 0;
+    rx_pos = 0;
+    return rx_len;
+}
+
+void transport_init(void) {
+    stdio_usb_init();
+    rx_len = rx_pos = 0;
+}
+
+void transport_deinit(void) {
+    // TODO: is there anyway / reason to deinit stdio_usb?
+    stdio_flush();
+}
+
+int transport_getchar_timeout_us(uint32_t timeout_us) {
+    uint32_t start = time_us_32();
+
+    while (!usb_available()) {
+        if ((time_us_32() - start) >= timeout_us)
+            return PICO_ERROR_TIMEOUT;
+        tight_loop_contents();
+    }
+
+    return rx_buf[rx_pos++];
+}
+
+int transport_getchar(void) {
+    while (!usb_available()) {
+        tight_loop_contents();
+    }
+
+    return rx_buf[rx_pos++];
+}
+
+uint32_t transport_read(uint8_t *dst, uint32_t len) {
+    uint32_t n = rx_len - rx_pos;
+    if (n > len)
+        n = len;
+    memcpy(dst, &rx_buf[rx_pos], n);
+    rx_pos += n;
+
+    // Anything more goes straight from the CDC FIFO into dst
+    if (n < len) {
+        int more = stdio_usb.in_chars((char *)dst + n, len - n);
+        if (more > 0)
+            n += more;
+    }
+
+    return n;
+}
+
+void transport_putchar(uint8_t c) {
+    stdio_usb.out_chars((const char *)&c, 1);
+}
+
+void transport_write(const void *src, uint32_t len) {
+    stdio_usb.out_chars(src, len);
+}
+
+void transport_puts(const char *s) {
+    transport_write(s, strlen(s));
+}
+
+void transport_flush(void) {
+    stdio_flush();
+}
+
+#endif
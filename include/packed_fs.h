@@ -0,0 +1,46 @@
+/**
+ * @file packed_fs.h
+ * @author IR
+ * @brief Header file for the files packed into the program
+ * @details source/packed_fs.c is generated by tools/pack_fs.py. Besides each file's data, it carries the response
+ * headers each is served with, worked out when it was packed, and perfect hashes of the files' names and of the URLs
+ * they are served at. A file is found with one hash and one compare, and served by writing its headers and data.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief A packed file
+ */
+struct packed_file {
+    const char *name;          // Path it was packed from, such as /web_root/main.js.gz
+    const unsigned char *data; // Followed by a terminating 0
+    size_t size;               // Bytes of data, the terminating 0 not counted
+    time_t mtime;
+    const char *etag;    // Quoted, as sent in ETag and compared against If-None-Match
+    const char *headers; // Content-Type, Content-Encoding, ETag and Cache-Control lines, each ending \r\n
+};
+
+/**
+ * @brief The packed file served at a URL
+ *
+ * @param url Request path, without the query string, need not be terminated
+ * @param len Length of the path
+ * @return const struct packed_file* File, NULL if no file is served at the URL
+ */
+const struct packed_file *packed_find(const char *url, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
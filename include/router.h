@@ -0,0 +1,80 @@
+/**
+ * @file router.h
+ * @author IR
+ * @brief Header file for the HTTP API's route table
+ * @details Routes are declared once, in ROUTES. router.cpp builds a perfect hash of their paths at compile time, so
+ * a request is matched with one hash and one compare however many routes there are, and anything that is not a
+ * route is known to be a static file just as quickly. net.c keeps a handler for each route, in the same order.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Methods a route accepts, any other is answered with 405
+#define ROUTE_GET (1u << 0)
+#define ROUTE_POST (1u << 1)
+
+// ROUTE(name, path, methods, auth), the handler for each is handle_<name> in net.c
+#define ROUTES(ROUTE)                                                   \
+    ROUTE(login, "/api/login", ROUTE_GET, true)                         \
+    ROUTE(logout, "/api/logout", ROUTE_GET, true)                       \
+    ROUTE(debug, "/api/debug", ROUTE_POST, true)                        \
+    ROUTE(stats_get, "/api/stats/get", ROUTE_GET, true)                 \
+    ROUTE(events_get, "/api/events/get", ROUTE_POST, true)              \
+    ROUTE(settings_get, "/api/settings/get", ROUTE_GET, true)           \
+    ROUTE(settings_set, "/api/settings/set", ROUTE_POST, true)          \
+    ROUTE(firmware_upload, "/api/firmware/upload", ROUTE_POST, true)    \
+    ROUTE(firmware_commit, "/api/firmware/commit", ROUTE_GET, true)     \
+    ROUTE(firmware_rollback, "/api/firmware/rollback", ROUTE_GET, true) \
+    ROUTE(firmware_status, "/api/firmware/status", ROUTE_GET, true)     \
+    ROUTE(scrub_get, "/api/scrub/get", ROUTE_GET, true)                 \
+    ROUTE(device_reset, "/api/device/reset", ROUTE_GET, true)           \
+    ROUTE(device_eraselast, "/api/device/eraselast", ROUTE_GET, true)
+
+#define ROUTE_ID(name, path, methods, auth) ROUTE_##name,
+
+typedef enum RouteId {
+    ROUTES(ROUTE_ID) ROUTE_Count
+} RouteId;
+
+/**
+ * @brief A route from ROUTES
+ */
+struct route {
+    const char *path;
+    size_t len;
+    uint8_t methods; // ROUTE_GET, ROUTE_POST
+    bool auth;       // Only for an authenticated user
+    uint8_t id;      // RouteId
+};
+
+/**
+ * @brief The route for a request path
+ *
+ * @param path Path, without the query string, need not be terminated
+ * @param len Length of the path
+ * @return const struct route* Route, NULL if the path is not one
+ */
+const struct route *router_find(const char *path, size_t len);
+
+/**
+ * @brief The ROUTE_ bit for a request method
+ *
+ * @return unsigned Method's bit, 0 for a method no route accepts
+ */
+unsigned router_method(const char *method, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
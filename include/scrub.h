@@ -0,0 +1,60 @@
+/**
+ * @file scrub.h
+ * @author IR
+ * @brief Header file for the background check of the running program against its flash header
+ * @details The bootloader only checks the program before branching into it. The scrubber keeps checking it while
+ * it runs, one sector at a time at idle priority, through the bootloader's service table (boot_api.h). Sectors are
+ * read past the XIP cache, so the running program is not evicted from it.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pause between sectors and between passes over the whole program
+#define SCRUB_SECTOR_DELAY_MS 20
+#define SCRUB_PASS_DELAY_MS (60 * 1000)
+
+typedef enum ScrubState {
+    SCRUB_Unavailable = 0, // Bootloader has no service table, or the flash header no sector table
+    SCRUB_Running = 1,     // Sectors are being checked
+    SCRUB_Waiting = 2,     // Between passes
+} ScrubState;
+
+/**
+ * @brief Progress and results of the scrubber
+ */
+typedef struct scrub_status {
+    uint32_t state;        // ScrubState
+    uint32_t sector;       // Sector being checked, counted from the start of the program
+    uint32_t sectors;      // Sectors in the program, known once a pass has completed
+    uint32_t passes;       // Completed passes over the whole program
+    uint32_t errors;       // Sectors that did not match, over every pass
+    int32_t first_bad;     // First sector that did not match, -1 if none has
+    uint32_t last_pass_ms; // Time the last completed pass took, pauses included
+} scrub_status_t;
+
+/**
+ * @brief Start the scrubber task at idle priority
+ *
+ * @note Call before vTaskStartScheduler
+ */
+void scrub_init(void);
+
+/**
+ * @brief Consistent copy of the scrubber's progress and results
+ */
+void scrub_get_status(scrub_status_t *status);
+
+#ifdef __cplusplus
+}
+#endif
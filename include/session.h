@@ -0,0 +1,59 @@
+/**
+ * @file session.h
+ * @author IR
+ * @brief Header file for the HTTP API's login sessions
+ * @details Logging in with a name and password creates a session under a random token, which is sent back as the
+ * access_token cookie. Every later request is authenticated by finding its token in a small hash table, keyed by the
+ * token's own random bytes, instead of decoding and comparing credentials again. Tokens are compared in constant time
+ * and sessions expire SESSION_LIFETIME_MS after login.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SESSION_MAX 8                               // Sessions held at once, the one closest to expiring makes room for a new one
+#define SESSION_TOKEN_BYTES 16                      // Random bytes in a token
+#define SESSION_TOKEN_LEN (2 * SESSION_TOKEN_BYTES) // Characters in a token, as lowercase hex
+#define SESSION_LIFETIME_MS (24 * 3600 * 1000)      // Also the cookie's Max-Age
+
+struct user;
+
+/**
+ * @brief Start a session for a user
+ *
+ * @param u User who logged in
+ * @param token Set to the session's token, terminated
+ */
+void session_create(const struct user *u, char token[SESSION_TOKEN_LEN + 1]);
+
+/**
+ * @brief The user of a session
+ *
+ * @param token Token presented by the client, need not be terminated
+ * @param len Length of the token
+ * @return const struct user* Session's user, NULL if the token is not that of a live session
+ */
+const struct user *session_find(const char *token, size_t len);
+
+/**
+ * @brief End a session, if the token is that of one
+ *
+ * @param token Token presented by the client, need not be terminated
+ * @param len Length of the token
+ */
+void session_delete(const char *token, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
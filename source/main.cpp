@@ -9,6 +9,7 @@
 
 #include "mongoose.h"
 #include "net.h"
+#include "scrub.h"
 #include "task.h"
 
 #define TEST_TASK_PRIORITY (tskIDLE_PRIORITY + 1UL)
@@ -97,6 +98,7 @@ void vLaunch(void) {
     TaskHandle_t task;
     xTaskCreate(main_task, "TestMainThread", TEST_TASK_STACK_SIZE, NULL, TEST_TASK_PRIORITY, &task);
     xTaskCreate(print_task, "PrintThread", TEST_TASK_STACK_SIZE / 2, NULL, tskIDLE_PRIORITY, &task);
+    scrub_init();
     vTaskStartScheduler();
 }
 
@@ -3,14 +3,25 @@
 
 #include "net.h"
 
+#include <pico/stdlib.h>
+
+#include "boot_api.h"
+#include "boot_info.h"
+#include "packed_fs.h"
+#include "router.h"
+#include "scrub.h"
+#include "session.h"
+
 // Authenticated user.
 // A user can be authenticated by:
 //   - a name:pass pair, passed in a header Authorization: Basic .....
-//   - an access_token, passed in a header Cookie: access_token=....
+//   - a session token, passed in a header Cookie: access_token=.... or
+//     Authorization: Bearer ....
 // When a user is shown a login screen, she enters a user:pass. If successful,
-// a server responds with a http-only access_token cookie set.
+// a server starts a session and responds with its token as a http-only
+// access_token cookie.
 struct user {
-    const char *name, *pass, *access_token;
+    const char *name, *pass;
 };
 
 // Settings
@@ -65,47 +76,76 @@ static void timer_sntp_fn(void *param) { // SNTP timer function. Sync up time
     mg_sntp_connect(param, "udp://time.google.com:123", sfn, NULL);
 }
 
+// Session token presented with a request, empty if there is none
+static struct mg_str session_token(struct mg_http_message *hm) {
+    struct mg_str *v = mg_http_get_header(hm, "Authorization");
+    if (v != NULL && v->len > 7 && memcmp(v->ptr, "Bearer ", 7) == 0)
+        return mg_str_n(v->ptr + 7, v->len - 7);
+    if ((v = mg_http_get_header(hm, "Cookie")) != NULL)
+        return mg_http_get_header_var(*v, mg_str_n("access_token", 12));
+    return mg_str_n(NULL, 0);
+}
+
+static bool basic_auth(struct mg_http_message *hm) {
+    struct mg_str *v = mg_http_get_header(hm, "Authorization");
+    return v != NULL && v->len > 6 && memcmp(v->ptr, "Basic ", 6) == 0;
+}
+
+// Time taken depends on the stored password's length alone, never on where the two differ
+static bool pass_equal(const char *given, const char *pass) {
+    size_t len = strlen(given), n = strlen(pass);
+    uint8_t diff = len != n;
+    for (size_t i = 0; i < n; i++)
+        diff |= (uint8_t)(pass[i] ^ (i < len ? given[i] : 0));
+    return diff == 0;
+}
+
 // Parse HTTP requests, return authenticated user or NULL
-static struct user *authenticate(struct mg_http_message *hm) {
-    // In production, make passwords strong and tokens randomly generated
-    // In this example, user list is kept in RAM. In production, it can
-    // be backed by file, database, or some other method.
-    static struct user users[] = {
-        {"admin", "admin", "admin_token"},
-        {"user1", "user1", "user1_token"},
-        {"user2", "user2", "user2_token"},
-        {NULL, NULL, NULL},
+static const struct user *authenticate(struct mg_http_message *hm) {
+    // In production, make passwords strong. In this example, user list is
+    // kept in RAM. In production, it can be backed by file, database, or
+    // some other method.
+    static const struct user users[] = {
+        {"admin", "admin"},
+        {"user1", "user1"},
+        {"user2", "user2"},
+        {NULL, NULL},
     };
     char user[64], pass[64];
-    struct user *u, *result = NULL;
-    mg_http_creds(hm, user, sizeof(user), pass, sizeof(pass));
-    MG_VERBOSE(("user [%s] pass [%s]", user, pass));
-
-    if (user[0] != '\0' && pass[0] != '\0') {
-        // Both user and password is set, search by user/password
-        for (u = users; result == NULL && u->name != NULL; u++)
-            if (strcmp(user, u->name) == 0 && strcmp(pass, u->pass) == 0)
-                result = u;
-    } else if (user[0] == '\0') {
-        // Only password is set, search by token
-        for (u = users; result == NULL && u->name != NULL; u++)
-            if (strcmp(pass, u->access_token) == 0)
-                result = u;
+    const struct user *u;
+
+    // Requests after login carry a session token, found without decoding any credentials
+    if (!basic_auth(hm)) {
+        struct mg_str token = session_token(hm);
+        return session_find(token.ptr, token.len);
     }
-    return result;
+
+    mg_http_creds(hm, user, sizeof(user), pass, sizeof(pass));
+    MG_VERBOSE(("user [%s]", user));
+    for (u = users; user[0] != '\0' && u->name != NULL; u++)
+        if (strcmp(user, u->name) == 0)
+            return pass_equal(pass, u->pass) ? u : NULL;
+    return NULL;
 }
 
-static void handle_login(struct mg_connection *c, struct user *u) {
-    char cookie[256];
-    mg_snprintf(cookie, sizeof(cookie),
-                "Set-Cookie: access_token=%s; Path=/; "
-                "%sHttpOnly; SameSite=Lax; Max-Age=%d\r\n",
-                u->access_token, c->is_tls ? "Secure; " : "", 3600 * 24);
+// Starts a session when the user logged in with a name and password, otherwise only reports the session's user
+static void handle_login(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
+    char cookie[256], token[SESSION_TOKEN_LEN + 1];
+    cookie[0] = '\0';
+    if (basic_auth(hm)) {
+        session_create(u, token);
+        mg_snprintf(cookie, sizeof(cookie),
+                    "Set-Cookie: access_token=%s; Path=/; "
+                    "%sHttpOnly; SameSite=Lax; Max-Age=%d\r\n",
+                    token, c->is_tls ? "Secure; " : "", SESSION_LIFETIME_MS / 1000);
+    }
     mg_http_reply(c, 200, cookie, "{%m:%m}", MG_ESC("user"), MG_ESC(u->name));
 }
 
-static void handle_logout(struct mg_connection *c) {
+static void handle_logout(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
+    struct mg_str token = session_token(hm);
     char cookie[256];
+    session_delete(token.ptr, token.len);
     mg_snprintf(cookie, sizeof(cookie),
                 "Set-Cookie: access_token=; Path=/; "
                 "Expires=Thu, 01 Jan 1970 00:00:00 UTC; "
@@ -114,7 +154,7 @@ static void handle_logout(struct mg_connection *c) {
     mg_http_reply(c, 200, cookie, "true\n");
 }
 
-static void handle_debug(struct mg_connection *c, struct mg_http_message *hm) {
+static void handle_debug(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
     int level = mg_json_get_long(hm->body, "$.level", MG_LL_DEBUG);
     mg_log_set(level);
     mg_http_reply(c, 200, "", "Debug level set to %d\n", level);
@@ -129,13 +169,29 @@ static size_t print_int_arr(void (*out)(char, void *), void *ptr, va_list *ap) {
     return len;
 }
 
-static void handle_stats_get(struct mg_connection *c) {
+// Boot reason and timings handed over by the bootloader
+static size_t print_boot(void (*out)(char, void *), void *ptr, va_list *ap) {
+    (void)ap;
+    if (!boot_info_valid())
+        return mg_xprintf(out, ptr, "null");
+    return mg_xprintf(out, ptr, "{%m:%lu,%m:%lu,%m:%lu,%m:%lu,%m:%lu,%m:%lu,%m:%lu}",
+                      MG_ESC("reason"), (unsigned long)__boot_info.reason,         //
+                      MG_ESC("generation"), (unsigned long)__boot_info.generation, //
+                      MG_ESC("verify_us"), (unsigned long)__boot_info.verify_us,   //
+                      MG_ESC("load_us"), (unsigned long)__boot_info.load_us,       //
+                      MG_ESC("erase_us"), (unsigned long)__boot_info.erase_us,     //
+                      MG_ESC("program_us"), (unsigned long)__boot_info.program_us, //
+                      MG_ESC("exit_us"), (unsigned long)__boot_info.exit_us);
+}
+
+static void handle_stats_get(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
     int points[] = {21, 22, 22, 19, 18, 20, 23, 23, 22, 22, 22, 23, 22};
-    mg_http_reply(c, 200, s_json_header, "{%m:%d,%m:%d,%m:[%M]}\n",
+    mg_http_reply(c, 200, s_json_header, "{%m:%d,%m:%d,%m:[%M],%m:%M}\n",
                   MG_ESC("temperature"), 21, //
                   MG_ESC("humidity"), 67,    //
                   MG_ESC("points"), print_int_arr,
-                  sizeof(points) / sizeof(points[0]), points);
+                  sizeof(points) / sizeof(points[0]), points, //
+                  MG_ESC("boot"), print_boot);
 }
 
 static size_t print_events(void (*out)(char, void *), void *ptr, va_list *ap) {
@@ -157,21 +213,20 @@ static size_t print_events(void (*out)(char, void *), void *ptr, va_list *ap) {
     return len;
 }
 
-static void handle_events_get(struct mg_connection *c,
-                              struct mg_http_message *hm) {
+static void handle_events_get(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
     int pageno = mg_json_get_long(hm->body, "$.page", 1);
     mg_http_reply(c, 200, s_json_header, "{%m:[%M], %m:%d}\n", MG_ESC("arr"),
                   print_events, pageno, MG_ESC("totalCount"), MAX_EVENTS_NO);
 }
 
-static void handle_settings_set(struct mg_connection *c, struct mg_str body) {
+static void handle_settings_set(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
     struct settings settings;
-    char *s = mg_json_get_str(body, "$.device_name");
+    char *s = mg_json_get_str(hm->body, "$.device_name");
     bool ok = true;
     memset(&settings, 0, sizeof(settings));
-    mg_json_get_bool(body, "$.log_enabled", &settings.log_enabled);
-    settings.log_level = mg_json_get_long(body, "$.log_level", 0);
-    settings.brightness = mg_json_get_long(body, "$.brightness", 0);
+    mg_json_get_bool(hm->body, "$.log_enabled", &settings.log_enabled);
+    settings.log_level = mg_json_get_long(hm->body, "$.log_level", 0);
+    settings.brightness = mg_json_get_long(hm->body, "$.brightness", 0);
     if (s && strlen(s) < MAX_DEVICE_NAME) {
         free(settings.device_name);
         settings.device_name = s;
@@ -185,7 +240,7 @@ static void handle_settings_set(struct mg_connection *c, struct mg_str body) {
                   MG_ESC("message"), MG_ESC(ok ? "Success" : "Failed"));
 }
 
-static void handle_settings_get(struct mg_connection *c) {
+static void handle_settings_get(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
     mg_http_reply(c, 200, s_json_header, "{%m:%s,%m:%hhu,%m:%hhu,%m:%m}\n", //
                   MG_ESC("log_enabled"),
                   s_settings.log_enabled ? "true" : "false",                //
@@ -194,8 +249,7 @@ static void handle_settings_get(struct mg_connection *c) {
                   MG_ESC("device_name"), MG_ESC(s_settings.device_name));
 }
 
-static void handle_firmware_upload(struct mg_connection *c,
-                                   struct mg_http_message *hm) {
+static void handle_firmware_upload(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
     char name[64], offset[20], total[20];
     struct mg_str data = hm->body;
     long ofs = -1, tot = -1;
@@ -204,6 +258,7 @@ static void handle_firmware_upload(struct mg_connection *c,
     mg_http_get_var(&hm->query, "offset", offset, sizeof(offset));
     mg_http_get_var(&hm->query, "total", total, sizeof(total));
     MG_INFO(("File %s, offset %s, len %lu", name, offset, data.len));
+    boot_info_invalidate(); // Flash is about to be written, have the bootloader verify it next boot
     if ((ofs = mg_json_get_long(mg_str(offset), "$", -1)) < 0 || (tot = mg_json_get_long(mg_str(total), "$", -1)) < 0) {
         mg_http_reply(c, 500, "", "offset and total not set\n");
     } else if (ofs == 0 && mg_ota_begin((size_t)tot) == false) {
@@ -222,12 +277,12 @@ static void handle_firmware_upload(struct mg_connection *c,
     }
 }
 
-static void handle_firmware_commit(struct mg_connection *c) {
+static void handle_firmware_commit(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
     mg_http_reply(c, 200, s_json_header, "%s\n",
                   mg_ota_commit() ? "true" : "false");
 }
 
-static void handle_firmware_rollback(struct mg_connection *c) {
+static void handle_firmware_rollback(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
     mg_http_reply(c, 200, s_json_header, "%s\n",
                   mg_ota_rollback() ? "true" : "false");
 }
@@ -240,26 +295,98 @@ static size_t print_status(void (*out)(char, void *), void *ptr, va_list *ap) {
                       MG_ESC("timestamp"), mg_ota_timestamp(fw));
 }
 
-static void handle_firmware_status(struct mg_connection *c) {
+static void handle_firmware_status(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
     mg_http_reply(c, 200, s_json_header, "[%M,%M]\n", print_status,
                   MG_FIRMWARE_CURRENT, print_status, MG_FIRMWARE_PREVIOUS);
 }
 
-static void handle_device_reset(struct mg_connection *c) {
+// Progress of the background check of the program against its flash header
+static void handle_scrub_get(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
+    scrub_status_t st;
+    scrub_get_status(&st);
+    mg_http_reply(c, 200, s_json_header, "{%m:%lu,%m:%lu,%m:%lu,%m:%lu,%m:%lu,%m:%ld,%m:%lu}\n",
+                  MG_ESC("state"), (unsigned long)st.state,     //
+                  MG_ESC("sector"), (unsigned long)st.sector,   //
+                  MG_ESC("sectors"), (unsigned long)st.sectors, //
+                  MG_ESC("passes"), (unsigned long)st.passes,   //
+                  MG_ESC("errors"), (unsigned long)st.errors,   //
+                  MG_ESC("first_bad"), (long)st.first_bad,      //
+                  MG_ESC("last_pass_ms"), (unsigned long)st.last_pass_ms);
+}
+
+static void handle_device_reset(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
     mg_http_reply(c, 200, s_json_header, "true\n");
     mg_timer_add(c->mgr, 500, 0, (void (*)(void *))mg_device_reset, NULL);
 }
 
-static void handle_device_eraselast(struct mg_connection *c) {
-    size_t ss = mg_flash_sector_size(), size = mg_flash_size();
-    char *base = (char *)mg_flash_start(), *last = base + size - ss;
-    if (mg_flash_bank() == 2)
-        last -= size / 2;
-    mg_flash_erase(last);
-    mg_http_reply(c, 200, s_json_header, "true\n");
+// Erased through the bootloader's service table, the app carries no flash driver of its own
+static void handle_device_eraselast(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) {
+    const boot_api_t *api = boot_api_get();
+    bool ok = false;
+    if (api != NULL) {
+        boot_info_invalidate();
+        ok = api->flash_erase(PICO_FLASH_SIZE_BYTES - BOOT_API_SECTOR_SIZE, BOOT_API_SECTOR_SIZE);
+    }
+    mg_http_reply(c, 200, s_json_header, "%s\n", ok ? "true" : "false");
+}
+
+#if MG_ARCH != MG_ARCH_UNIX && MG_ARCH != MG_ARCH_WIN32
+// Rest of a packed file's data, sent a send buffer at a time as the connection drains
+struct packed_send {
+    const unsigned char *ptr;
+    size_t len;
+};
+
+_Static_assert(sizeof(struct packed_send) <= MG_DATA_SIZE, "kept in the connection's data");
+
+static void packed_send_more(struct mg_connection *c) {
+    struct packed_send *p = (struct packed_send *)c->data;
+    size_t n;
+
+    if (p->len == 0 || c->send.len >= MG_IO_SIZE)
+        return;
+    n = MG_IO_SIZE - c->send.len;
+    if (n > p->len)
+        n = p->len;
+    mg_send(c, p->ptr, n);
+    p->ptr += n;
+    p->len -= n;
+    if (p->len == 0)
+        c->is_resp = 0; // Response complete, the next request on the connection can be read
 }
 
-// HTTP request handler function
+// One lookup finds the file and the headers it is served with, worked out when it was packed (tools/pack_fs.py)
+static void serve_packed(struct mg_connection *c, struct mg_http_message *hm) {
+    const struct packed_file *f = packed_find(hm->uri.ptr, hm->uri.len);
+    struct mg_str *inm;
+    struct packed_send *p = (struct packed_send *)c->data;
+
+    if (f == NULL) {
+        mg_http_reply(c, 404, "", "Not found\n");
+    } else if ((inm = mg_http_get_header(hm, "If-None-Match")) != NULL && mg_strcmp(*inm, mg_str(f->etag)) == 0) {
+        mg_printf(c, "HTTP/1.1 304 Not Modified\r\n%sContent-Length: 0\r\n\r\n", f->headers);
+        c->is_resp = 0; // Mongoose set it before MG_EV_HTTP_MSG, only its own replies clear it
+    } else {
+        mg_printf(c, "HTTP/1.1 200 OK\r\n%sContent-Length: %lu\r\n\r\n", f->headers, (unsigned long)f->size);
+        if (mg_vcasecmp(&hm->method, "HEAD") != 0 && f->size > 0) {
+            // is_resp stays set until packed_send_more has sent the last of the data
+            p->ptr = f->data;
+            p->len = f->size;
+            packed_send_more(c);
+        } else {
+            c->is_resp = 0;
+        }
+    }
+}
+#endif
+
+// Handler for every route, in the order of ROUTES
+#define ROUTE_HANDLER(name, path, methods, auth) handle_##name,
+static void (*const route_handlers[ROUTE_Count])(struct mg_connection *c, struct mg_http_message *hm, const struct user *u) = {
+    ROUTES(ROUTE_HANDLER)};
+#undef ROUTE_HANDLER
+
+// HTTP request handler function. API routes are found with one hash lookup, anything else is a static file.
 static void fn(struct mg_connection *c, int ev, void *ev_data) {
     if (ev == MG_EV_ACCEPT) {
         if (c->fn_data != NULL) { // TLS listener!
@@ -270,50 +397,41 @@ static void fn(struct mg_connection *c, int ev, void *ev_data) {
         }
     } else if (ev == MG_EV_HTTP_MSG) {
         struct mg_http_message *hm = (struct mg_http_message *)ev_data;
-        struct user *u = authenticate(hm);
+        const struct route *r = router_find(hm->uri.ptr, hm->uri.len);
+        bool api = (hm->uri.len >= 5) && !memcmp(hm->uri.ptr, "/api/", 5);
+        bool needs_auth = (r != NULL) ? r->auth : api; // Static files are served to anyone
+        const struct user *u = NULL;
 
-        if (mg_http_match_uri(hm, "/api/#") && u == NULL) {
+        if (needs_auth && (u = authenticate(hm)) == NULL) {
             mg_http_reply(c, 403, "", "Not Authorised\n");
-        } else if (mg_http_match_uri(hm, "/api/login")) {
-            handle_login(c, u);
-        } else if (mg_http_match_uri(hm, "/api/logout")) {
-            handle_logout(c);
-        } else if (mg_http_match_uri(hm, "/api/debug")) {
-            handle_debug(c, hm);
-        } else if (mg_http_match_uri(hm, "/api/stats/get")) {
-            handle_stats_get(c);
-        } else if (mg_http_match_uri(hm, "/api/events/get")) {
-            handle_events_get(c, hm);
-        } else if (mg_http_match_uri(hm, "/api/settings/get")) {
-            handle_settings_get(c);
-        } else if (mg_http_match_uri(hm, "/api/settings/set")) {
-            handle_settings_set(c, hm->body);
-        } else if (mg_http_match_uri(hm, "/api/firmware/upload")) {
-            handle_firmware_upload(c, hm);
-        } else if (mg_http_match_uri(hm, "/api/firmware/commit")) {
-            handle_firmware_commit(c);
-        } else if (mg_http_match_uri(hm, "/api/firmware/rollback")) {
-            handle_firmware_rollback(c);
-        } else if (mg_http_match_uri(hm, "/api/firmware/status")) {
-            handle_firmware_status(c);
-        } else if (mg_http_match_uri(hm, "/api/device/reset")) {
-            handle_device_reset(c);
-        } else if (mg_http_match_uri(hm, "/api/device/eraselast")) {
-            handle_device_eraselast(c);
+        } else if (r == NULL && api) {
+            mg_http_reply(c, 404, "", "Not Found\n");
+        } else if (r != NULL && !(r->methods & router_method(hm->method.ptr, hm->method.len))) {
+            char allow[32];
+            mg_snprintf(allow, sizeof(allow), "Allow: %s%s%s\r\n",
+                        (r->methods & ROUTE_GET) ? "GET" : "",
+                        (r->methods & ROUTE_GET) && (r->methods & ROUTE_POST) ? ", " : "",
+                        (r->methods & ROUTE_POST) ? "POST" : "");
+            mg_http_reply(c, 405, allow, "Method Not Allowed\n");
+        } else if (r != NULL) {
+            route_handlers[r->id](c, hm, u);
         } else {
+#if MG_ARCH == MG_ARCH_UNIX || MG_ARCH == MG_ARCH_WIN32
             struct mg_http_serve_opts opts;
             memset(&opts, 0, sizeof(opts));
-#if MG_ARCH == MG_ARCH_UNIX || MG_ARCH == MG_ARCH_WIN32
             opts.root_dir = "web_root"; // On workstations, use filesystem
+            mg_http_serve_dir(c, ev_data, &opts);
 #else
-            opts.root_dir = "/web_root"; // On embedded, use packed files
-            opts.fs = &mg_fs_packed;
+            serve_packed(c, hm); // On embedded, use packed files
 #endif
-            mg_http_serve_dir(c, ev_data, &opts);
         }
         MG_DEBUG(("%lu %.*s %.*s -> %.*s", c->id, (int)hm->method.len,
                   hm->method.ptr, (int)hm->uri.len, hm->uri.ptr, (int)3,
                   &c->send.buf[9]));
+#if MG_ARCH != MG_ARCH_UNIX && MG_ARCH != MG_ARCH_WIN32
+    } else if (ev == MG_EV_POLL || ev == MG_EV_WRITE) {
+        packed_send_more(c);
+#endif
     }
 }
 
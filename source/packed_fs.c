@@ -1,7 +1,11 @@
+// Generated by tools/pack_fs.py, do not edit
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <time.h>
 
+#include "packed_fs.h"
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -2661,37 +2665,80 @@ static const unsigned char v8[] = {
   69,  32,  75,  69,  89,  45,  45,  45,  45,  45,  10, 0 // E KEY-----.
 };
 
-static const struct packed_file {
-  const char *name;
-  const unsigned char *data;
-  size_t size;
-  time_t mtime;
-} packed_files[] = {
-  {"/web_root/bundle.js.gz", v1, sizeof(v1), 1695912421},
-  {"/web_root/components.js.gz", v2, sizeof(v2), 1703179015},
-  {"/web_root/history.min.js.gz", v3, sizeof(v3), 1695912421},
-  {"/web_root/index.html.gz", v4, sizeof(v4), 1693654553},
-  {"/web_root/main.css.gz", v5, sizeof(v5), 1702757929},
-  {"/web_root/main.js.gz", v6, sizeof(v6), 1706219101},
-  {"/certs/server_cert.pem", v7, sizeof(v7), 1692695603},
-  {"/certs/server_key.pem", v8, sizeof(v8), 1692695603},
-  {NULL, NULL, 0, 0}
+static const struct packed_file packed_files[] = {
+  {"/web_root/bundle.js.gz", v1, sizeof(v1) - 1, 1695912421, "\"65facd66\"",
+   "Content-Type: text/javascript; charset=utf-8\r\n"
+   "Content-Encoding: gzip\r\n"
+   "ETag: \"65facd66\"\r\n"
+   "Cache-Control: no-cache\r\n"},
+  {"/web_root/components.js.gz", v2, sizeof(v2) - 1, 1703179015, "\"e704560b\"",
+   "Content-Type: text/javascript; charset=utf-8\r\n"
+   "Content-Encoding: gzip\r\n"
+   "ETag: \"e704560b\"\r\n"
+   "Cache-Control: no-cache\r\n"},
+  {"/web_root/history.min.js.gz", v3, sizeof(v3) - 1, 1695912421, "\"1438641a\"",
+   "Content-Type: text/javascript; charset=utf-8\r\n"
+   "Content-Encoding: gzip\r\n"
+   "ETag: \"1438641a\"\r\n"
+   "Cache-Control: no-cache\r\n"},
+  {"/web_root/index.html.gz", v4, sizeof(v4) - 1, 1693654553, "\"5633369f\"",
+   "Content-Type: text/html; charset=utf-8\r\n"
+   "Content-Encoding: gzip\r\n"
+   "ETag: \"5633369f\"\r\n"
+   "Cache-Control: no-cache\r\n"},
+  {"/web_root/main.css.gz", v5, sizeof(v5) - 1, 1702757929, "\"0ce999d7\"",
+   "Content-Type: text/css; charset=utf-8\r\n"
+   "Content-Encoding: gzip\r\n"
+   "ETag: \"0ce999d7\"\r\n"
+   "Cache-Control: no-cache\r\n"},
+  {"/web_root/main.js.gz", v6, sizeof(v6) - 1, 1706219101, "\"cad0c19c\"",
+   "Content-Type: text/javascript; charset=utf-8\r\n"
+   "Content-Encoding: gzip\r\n"
+   "ETag: \"cad0c19c\"\r\n"
+   "Cache-Control: no-cache\r\n"},
+  {"/certs/server_cert.pem", v7, sizeof(v7) - 1, 1692695603, NULL, NULL},
+  {"/certs/server_key.pem", v8, sizeof(v8) - 1, 1692695603, NULL, NULL},
+  {NULL, NULL, 0, 0, NULL, NULL}
 };
 
-static int scmp(const char *a, const char *b) {
-  while (*a && (*a == *b)) a++, b++;
-  return *(const unsigned char *) a - *(const unsigned char *) b;
+// URL every served file answers to, and the file in packed_files for each
+static const char *const packed_urls[] = {"/bundle.js", "/components.js", "/history.min.js", "/index.html", "/", "/main.css", "/main.js"};
+static const signed char packed_url_files[] = {0, 1, 2, 3, 3, 4, 5};
+
+// Perfect hashes, the index of the key in each slot and -1 for a slot no key hashes to
+#define PACKED_NAME_SEED 15u
+#define PACKED_NAME_BITS 4
+#define PACKED_URL_SEED 4u
+#define PACKED_URL_BITS 4
+static const signed char packed_name_slots[] = {-1, -1, 5, 6, -1, 3, -1, 7, 2, -1, 0, -1, -1, 1, 4, -1};
+static const signed char packed_url_slots[] = {3, 5, 4, -1, -1, -1, -1, 6, 2, 1, -1, -1, -1, -1, 0, -1};
+
+static uint32_t packed_slot(const char *key, size_t len, uint32_t seed, unsigned bits) {
+  uint32_t hash = 2166136261u ^ seed;
+  while (len--) {
+    hash ^= (unsigned char) *key++;
+    hash *= 16777619u;
+  }
+  return hash >> (32 - bits);
+}
+static int packed_eq(const char *a, const char *b, size_t len) {
+  return strncmp(a, b, len) == 0 && a[len] == '\0';
 }
 const char *mg_unlist(size_t no) {
   return packed_files[no].name;
 }
 const char *mg_unpack(const char *name, size_t *size, time_t *mtime) {
+  size_t len = strlen(name);
+  int i = packed_name_slots[packed_slot(name, len, PACKED_NAME_SEED, PACKED_NAME_BITS)];
   const struct packed_file *p;
-  for (p = packed_files; p->name != NULL; p++) {
-    if (scmp(p->name, name) != 0) continue;
-    if (size != NULL) *size = p->size - 1;
-    if (mtime != NULL) *mtime = p->mtime;
-    return (const char *) p->data;
-  }
-  return NULL;
+  if (i < 0 || !packed_eq(packed_files[i].name, name, len)) return NULL;
+  p = &packed_files[i];
+  if (size != NULL) *size = p->size;
+  if (mtime != NULL) *mtime = p->mtime;
+  return (const char *) p->data;
+}
+const struct packed_file *packed_find(const char *url, size_t len) {
+  int i = packed_url_slots[packed_slot(url, len, PACKED_URL_SEED, PACKED_URL_BITS)];
+  if (i < 0 || !packed_eq(packed_urls[i], url, len)) return NULL;
+  return &packed_files[packed_url_files[i]];
 }
@@ -0,0 +1,91 @@
+/**
+ * @file router.cpp
+ * @author IR
+ * @brief Source file for the HTTP API's route table
+ * @details The seed of an FNV-1a hash is searched for at compile time until every route lands in a slot of its own,
+ * in a table at least twice the size of ROUTES. A path is looked up by hashing it once and comparing it against
+ * the one route in its slot.
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "router.h"
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+namespace {
+
+    constexpr route routes[] = {
+#define ROUTE_ENTRY(name, path, methods, auth) {path, sizeof(path) - 1, methods, auth, ROUTE_##name},
+        ROUTES(ROUTE_ENTRY)
+#undef ROUTE_ENTRY
+    };
+
+    static_assert(std::size(routes) == ROUTE_Count);
+    static_assert(ROUTE_Count < INT8_MAX, "route indices are kept in an int8_t");
+
+    constexpr unsigned slot_bits = std::bit_width(2 * std::size(routes) - 1);
+    constexpr size_t slot_count = size_t(1) << slot_bits;
+
+    constexpr uint32_t slot(std::string_view path, uint32_t seed) {
+        uint32_t hash = 2166136261u ^ seed;
+        for (char c : path) {
+            hash ^= uint8_t(c);
+            hash *= 16777619u;
+        }
+        return hash >> (32 - slot_bits);
+    }
+
+    constexpr bool collides(uint32_t seed) {
+        std::array<bool, slot_count> used{};
+        for (const auto &r : routes) {
+            uint32_t s = slot({r.path, r.len}, seed);
+            if (used[s])
+                return true;
+            used[s] = true;
+        }
+        return false;
+    }
+
+    constexpr uint32_t seed = [] {
+        uint32_t s = 0;
+        while (collides(s))
+            s++;
+        return s;
+    }();
+
+    // Index into routes for every slot, -1 for a slot no route hashes to
+    constexpr auto slots = [] {
+        std::array<int8_t, slot_count> table{};
+        table.fill(-1);
+        for (size_t i = 0; i < std::size(routes); i++)
+            table[slot({routes[i].path, routes[i].len}, seed)] = int8_t(i);
+        return table;
+    }();
+
+} // namespace
+
+extern "C" const route *router_find(const char *path, size_t len) {
+    std::string_view request(path, len);
+    int8_t i = slots[slot(request, seed)];
+
+    if ((i < 0) || (std::string_view(routes[i].path, routes[i].len) != request))
+        return nullptr;
+    return &routes[i];
+}
+
+extern "C" unsigned router_method(const char *method, size_t len) {
+    std::string_view request(method, len);
+
+    if (request == "GET")
+        return ROUTE_GET;
+    if (request == "POST")
+        return ROUTE_POST;
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file scrub.c
+ * @author IR
+ * @brief Source file for the background check of the running program against its flash header
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "scrub.h"
+
+#include <FreeRTOS.h>
+#include <hardware/dma.h>
+#include <task.h>
+
+#include "boot_api.h"
+#include "boot_info.h"
+
+#define SCRUB_TASK_STACK_SIZE ((configSTACK_DEPTH_TYPE)256)
+
+static scrub_status_t status = {.state = SCRUB_Unavailable, .first_bad = -1};
+
+static void scrub_publish(const scrub_status_t *next) {
+    taskENTER_CRITICAL();
+    status = *next;
+    taskEXIT_CRITICAL();
+}
+
+void scrub_get_status(scrub_status_t *out) {
+    taskENTER_CRITICAL();
+    *out = status;
+    taskEXIT_CRITICAL();
+}
+
+static void scrub_task(__unused void *params) {
+    const boot_api_t *api = boot_api_get();
+    int channel = dma_claim_unused_channel(false);
+    scrub_status_t next = status;
+
+    // Nothing to check against, or nothing to check with
+    if ((api == NULL) || (channel < 0) || (api->image_check_sector(channel, 0) < 0)) {
+        if (channel >= 0)
+            dma_channel_unclaim(channel);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (true) {
+        TickType_t start = xTaskGetTickCount();
+        int32_t match;
+
+        next.state = SCRUB_Running;
+        for (next.sector = 0; (match = api->image_check_sector(channel, next.sector)) >= 0; next.sector++) {
+            if (!match) {
+                next.errors++;
+                if (next.first_bad < 0)
+                    next.first_bad = next.sector;
+                // Have the bootloader check the whole program again on the next boot, rather than trust it
+                boot_info_invalidate();
+            }
+            scrub_publish(&next);
+            vTaskDelay(pdMS_TO_TICKS(SCRUB_SECTOR_DELAY_MS));
+        }
+
+        next.state = SCRUB_Waiting;
+        next.sectors = next.sector;
+        next.passes++;
+        next.last_pass_ms = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+        scrub_publish(&next);
+        vTaskDelay(pdMS_TO_TICKS(SCRUB_PASS_DELAY_MS));
+    }
+}
+
+void scrub_init(void) {
+    xTaskCreate(scrub_task, "ScrubThread", SCRUB_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY, NULL);
+}
@@ -0,0 +1,149 @@
+/**
+ * @file session.c
+ * @author IR
+ * @brief Source file for the HTTP API's login sessions
+ * @version 0.1
+ * @date 2024-04-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "session.h"
+
+#include <pico/rand.h>
+#include <string.h>
+
+#include "mongoose.h"
+
+#define SESSION_SLOTS (2 * SESSION_MAX) // Power of two, so a token's bytes pick a slot with a mask
+
+struct session {
+    uint8_t token[SESSION_TOKEN_BYTES];
+    const struct user *user; // NULL for a free session
+    uint64_t expires;        // mg_millis() the session ends at
+};
+
+_Static_assert(SESSION_TOKEN_BYTES <= sizeof(rng_128_t), "a token is taken from one get_rand_128");
+
+static struct session sessions[SESSION_MAX];
+static int8_t slots[SESSION_SLOTS]; // Index into sessions for every slot, -1 for a free slot
+static bool slots_ready = false;
+
+// Tokens are random, so their first bytes are already as good as any hash of them
+static uint32_t session_slot(const uint8_t token[SESSION_TOKEN_BYTES]) {
+    uint32_t hash;
+    memcpy(&hash, token, sizeof(hash));
+    return hash & (SESSION_SLOTS - 1);
+}
+
+// Time taken depends on len alone, never on where the tokens differ
+static bool session_equal(const uint8_t *a, const uint8_t *b, size_t len) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; i++)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+static void session_insert(int8_t index) {
+    uint32_t s = session_slot(sessions[index].token);
+    while (slots[s] >= 0)
+        s = (s + 1) & (SESSION_SLOTS - 1);
+    slots[s] = index;
+}
+
+// Sessions are only removed on logout, expiry or eviction, so the few slots are rebuilt rather than tombstoned
+static void session_reindex(void) {
+    memset(slots, -1, sizeof(slots));
+    for (int8_t i = 0; i < SESSION_MAX; i++)
+        if (sessions[i].user != NULL)
+            session_insert(i);
+    slots_ready = true;
+}
+
+static void session_remove(struct session *s) {
+    memset(s, 0, sizeof(*s));
+    session_reindex();
+}
+
+// Only exactly SESSION_TOKEN_LEN hex characters are a token
+static bool session_decode(const char *token, size_t len, uint8_t out[SESSION_TOKEN_BYTES]) {
+    if (len != SESSION_TOKEN_LEN)
+        return false;
+    for (size_t i = 0; i < SESSION_TOKEN_LEN; i++) {
+        char c = token[i];
+        uint8_t nibble;
+        if (c >= '0' && c <= '9')
+            nibble = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            nibble = c - 'a' + 10;
+        else
+            return false;
+        out[i / 2] = (i & 1) ? (out[i / 2] | nibble) : (nibble << 4);
+    }
+    return true;
+}
+
+static struct session *session_lookup(const char *token, size_t len) {
+    uint8_t bytes[SESSION_TOKEN_BYTES];
+
+    if (!slots_ready || !session_decode(token, len, bytes))
+        return NULL;
+
+    for (uint32_t s = session_slot(bytes), n = 0; (n < SESSION_SLOTS) && (slots[s] >= 0); s = (s + 1) & (SESSION_SLOTS - 1), n++) {
+        struct session *session = &sessions[slots[s]];
+        if (session_equal(session->token, bytes, SESSION_TOKEN_BYTES))
+            return session;
+    }
+    return NULL;
+}
+
+void session_create(const struct user *u, char token[SESSION_TOKEN_LEN + 1]) {
+    uint64_t now = mg_millis();
+    struct session *s = &sessions[0];
+    rng_128_t rand;
+
+    if (!slots_ready)
+        session_reindex();
+
+    // A free or expired session, otherwise the one closest to expiring
+    for (int i = 0; i < SESSION_MAX; i++) {
+        struct session *c = &sessions[i];
+        if ((c->user == NULL) || (c->expires <= now)) {
+            s = c;
+            break;
+        }
+        if (c->expires < s->expires)
+            s = c;
+    }
+    if (s->user != NULL)
+        session_remove(s);
+
+    get_rand_128(&rand);
+    memcpy(s->token, rand.r, SESSION_TOKEN_BYTES);
+    s->user = u;
+    s->expires = now + SESSION_LIFETIME_MS;
+    session_insert((int8_t)(s - sessions));
+
+    for (int i = 0; i < SESSION_TOKEN_BYTES; i++)
+        mg_snprintf(&token[2 * i], 3, "%02x", s->token[i]);
+}
+
+const struct user *session_find(const char *token, size_t len) {
+    struct session *s = session_lookup(token, len);
+
+    if (s == NULL)
+        return NULL;
+    if (s->expires <= mg_millis()) {
+        session_remove(s);
+        return NULL;
+    }
+    return s->user;
+}
+
+void session_delete(const char *token, size_t len) {
+    struct session *s = session_lookup(token, len);
+
+    if (s != NULL)
+        session_remove(s);
+}
@@ -0,0 +1,226 @@
+"""Pack files into source/packed_fs.c, indexed and with their HTTP response headers worked out
+
+Every file is named by the path it is given as, with a leading /, the way Mongoose's pack names them, so
+mg_unpack("/certs/server_key.pem") keeps working for files that are not served.
+
+Files under the --serve directory are served at the URL of their path within it, less any .gz, and an index.html
+is also served at the directory it is in. Their ETag is the CRC32 of their data and their Content-Type comes from
+their extension. A .gz file is served with Content-Encoding: gzip. A name carrying a content hash, such as
+main.1a2b3c4d.js, is served as immutable, anything else has to be revalidated against its ETag.
+
+Names and URLs are each looked up with a perfect hash, FNV-1a with a seed searched for here until every key has a
+slot of its own, in a table at least twice the size of the keys.
+
+    python tools/pack_fs.py -o source/packed_fs.c web_root/*.gz certs/*.pem
+"""
+import argparse
+import binascii
+import os
+import re
+import sys
+from typing import Dict, List, Tuple
+
+CONTENT_TYPES = {
+    '.html': "text/html; charset=utf-8",
+    '.htm': "text/html; charset=utf-8",
+    '.js': "text/javascript; charset=utf-8",
+    '.mjs': "text/javascript; charset=utf-8",
+    '.css': "text/css; charset=utf-8",
+    '.json': "application/json",
+    '.svg': "image/svg+xml",
+    '.png': "image/png",
+    '.jpg': "image/jpeg",
+    '.ico': "image/x-icon",
+    '.txt': "text/plain; charset=utf-8",
+    '.pem': "application/x-pem-file",
+    '.wasm': "application/wasm",
+}
+DEFAULT_CONTENT_TYPE = "application/octet-stream"
+
+CACHE_IMMUTABLE = "public, max-age=31536000, immutable"
+CACHE_REVALIDATE = "no-cache"
+
+# A content hash in a file name, main.1a2b3c4d.js or main-1a2b3c4d.js
+HASHED_NAME = re.compile(r'[.-][0-9a-fA-F]{8,}\.')
+
+BYTES_PER_LINE = 12
+
+
+def fnv_slot(key: bytes, seed: int, bits: int) -> int:
+    """Slot of a key, must match packed_slot() in the generated file"""
+    h = 2166136261 ^ seed
+    for b in key:
+        h ^= b
+        h = (h * 16777619) & 0xFFFFFFFF
+    return h >> (32 - bits)
+
+
+def perfect_hash(keys: List[bytes]) -> Tuple[int, int, List[int]]:
+    """Seed, slot bits and slot table, of indices into keys and -1 for free slots, that give every key its own slot"""
+    bits = max(1, (2 * len(keys) - 1).bit_length())
+    seed = 0
+    while True:
+        slots = [-1] * (1 << bits)
+        for i, key in enumerate(keys):
+            s = fnv_slot(key, seed, bits)
+            if slots[s] >= 0:
+                break
+            slots[s] = i
+        else:
+            return seed, bits, slots
+        seed += 1
+
+
+def c_string(s: str) -> str:
+    return '"' + s.replace('\\', '\\\\').replace('"', '\\"').replace('\r', '\\r').replace('\n', '\\n') + '"'
+
+
+def headers_for(name: str, data: bytes) -> Tuple[str, List[str]]:
+    """ETag and response header lines for a served file"""
+    gzip = name.endswith('.gz')
+    base = name[:-3] if gzip else name
+    etag = '"%08x"' % (binascii.crc32(data) & 0xFFFFFFFF)
+    lines = ["Content-Type: %s\r\n" % CONTENT_TYPES.get(os.path.splitext(base)[1].lower(), DEFAULT_CONTENT_TYPE)]
+    if gzip:
+        lines.append("Content-Encoding: gzip\r\n")
+    lines.append("ETag: %s\r\n" % etag)
+    lines.append("Cache-Control: %s\r\n" % (CACHE_IMMUTABLE if HASHED_NAME.search(os.path.basename(base)) else CACHE_REVALIDATE))
+    return etag, lines
+
+
+def urls_for(name: str, serve: str) -> List[str]:
+    """URLs a file is served at, none if it is not under the served directory"""
+    if not name.startswith(serve + '/'):
+        return []
+    url = name[len(serve):]
+    if url.endswith('.gz'):
+        url = url[:-3]
+    urls = [url]
+    if os.path.basename(url) == 'index.html':
+        urls.append(url[:-len('index.html')])
+    return urls
+
+
+def write_array(out, no: int, data: bytes) -> None:
+    """Data as Mongoose's pack writes it, a terminating 0 appended"""
+    out.write("static const unsigned char v%d[] = {\n" % no)
+    ascii = ''
+    for i, b in enumerate(data):
+        if i and i % BYTES_PER_LINE == 0:
+            out.write(" // %s\n" % ascii)
+            ascii = ''
+        ascii += chr(b) if 32 <= b < 127 and b != 0x5C else '.'  # No backslash to splice the comment onto the next line
+        out.write(" %3u," % b)
+    out.write(" 0 // %s\n};\n" % ascii)
+
+
+def pack(paths: List[str], serve: str, out) -> None:
+    files = []
+    for path in paths:
+        with open(path, 'rb') as f:
+            data = f.read()
+        name = '/' + os.path.normpath(path).replace(os.sep, '/').lstrip('/')
+        files.append((name, data, int(os.stat(path).st_mtime)))
+
+    if len(files) > 127:
+        raise ValueError("slots hold file indices in a signed char")
+    names = [name.encode() for name, _, _ in files]
+    if len(set(names)) != len(names):
+        raise ValueError("a file is given more than once")
+
+    urls: Dict[str, int] = {}
+    for i, (name, _, _) in enumerate(files):
+        for url in urls_for(name, serve):
+            if url in urls:
+                raise ValueError("%s is served by both %s and %s" % (url, files[urls[url]][0], name))
+            urls[url] = i
+    url_keys = list(urls)
+
+    name_seed, name_bits, name_slots = perfect_hash(names)
+    url_seed, url_bits, url_slots = perfect_hash([url.encode() for url in url_keys] or [b''])
+    if not url_keys:
+        url_slots = [-1] * len(url_slots)
+
+    out.write("// Generated by tools/pack_fs.py, do not edit\n")
+    out.write("#include <stddef.h>\n#include <stdint.h>\n#include <string.h>\n#include <time.h>\n\n")
+    out.write('#include "packed_fs.h"\n\n')
+    out.write("#if defined(__cplusplus)\nextern \"C\" {\n#endif\n")
+    out.write("const char *mg_unlist(size_t no);\n")
+    out.write("const char *mg_unpack(const char *, size_t *, time_t *);\n")
+    out.write("#if defined(__cplusplus)\n}\n#endif\n\n")
+
+    for i, (_, data, _) in enumerate(files):
+        write_array(out, i + 1, data)
+
+    out.write("\nstatic const struct packed_file packed_files[] = {\n")
+    for i, (name, data, mtime) in enumerate(files):
+        if urls_for(name, serve):
+            etag, lines = headers_for(name, data)
+            out.write("  {%s, v%d, sizeof(v%d) - 1, %d, %s,\n" % (c_string(name), i + 1, i + 1, mtime, c_string(etag)))
+            out.write('\n'.join("   " + c_string(line) for line in lines) + "},\n")
+        else:
+            out.write("  {%s, v%d, sizeof(v%d) - 1, %d, NULL, NULL},\n" % (c_string(name), i + 1, i + 1, mtime))
+    out.write("  {NULL, NULL, 0, 0, NULL, NULL}\n};\n\n")
+
+    out.write("// URL every served file answers to, and the file in packed_files for each\n")
+    out.write("static const char *const packed_urls[] = {%s};\n" % (', '.join(map(c_string, url_keys)) or "NULL"))
+    out.write("static const signed char packed_url_files[] = {%s};\n\n" % (', '.join(str(urls[url]) for url in url_keys) or "-1"))
+
+    out.write("// Perfect hashes, the index of the key in each slot and -1 for a slot no key hashes to\n")
+    out.write("#define PACKED_NAME_SEED %du\n#define PACKED_NAME_BITS %d\n" % (name_seed, name_bits))
+    out.write("#define PACKED_URL_SEED %du\n#define PACKED_URL_BITS %d\n" % (url_seed, url_bits))
+    out.write("static const signed char packed_name_slots[] = {%s};\n" % ', '.join(map(str, name_slots)))
+    out.write("static const signed char packed_url_slots[] = {%s};\n\n" % ', '.join(map(str, url_slots)))
+
+    out.write(LOOKUP)
+
+
+LOOKUP = r"""static uint32_t packed_slot(const char *key, size_t len, uint32_t seed, unsigned bits) {
+  uint32_t hash = 2166136261u ^ seed;
+  while (len--) {
+    hash ^= (unsigned char) *key++;
+    hash *= 16777619u;
+  }
+  return hash >> (32 - bits);
+}
+static int packed_eq(const char *a, const char *b, size_t len) {
+  return strncmp(a, b, len) == 0 && a[len] == '\0';
+}
+const char *mg_unlist(size_t no) {
+  return packed_files[no].name;
+}
+const char *mg_unpack(const char *name, size_t *size, time_t *mtime) {
+  size_t len = strlen(name);
+  int i = packed_name_slots[packed_slot(name, len, PACKED_NAME_SEED, PACKED_NAME_BITS)];
+  const struct packed_file *p;
+  if (i < 0 || !packed_eq(packed_files[i].name, name, len)) return NULL;
+  p = &packed_files[i];
+  if (size != NULL) *size = p->size;
+  if (mtime != NULL) *mtime = p->mtime;
+  return (const char *) p->data;
+}
+const struct packed_file *packed_find(const char *url, size_t len) {
+  int i = packed_url_slots[packed_slot(url, len, PACKED_URL_SEED, PACKED_URL_BITS)];
+  if (i < 0 || !packed_eq(packed_urls[i], url, len)) return NULL;
+  return &packed_files[packed_url_files[i]];
+}
+"""
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('files', nargs='+', help="Files to pack, named by the path given")
+    parser.add_argument('-o', '--output', help="Generated source, standard output by default")
+    parser.add_argument('--serve', default='/web_root', help="Directory whose files are served over HTTP")
+    args = parser.parse_args()
+
+    if args.output is None:
+        pack(args.files, args.serve.rstrip('/'), sys.stdout)
+    else:
+        with open(args.output, 'w', newline='\n') as out:
+            pack(args.files, args.serve.rstrip('/'), out)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())